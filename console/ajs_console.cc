@@ -80,6 +80,8 @@ static const char consoleXML[] =
     "   <property name=\"engine\" type=\"s\" access=\"read\"/> "
     "   <property name=\"maxEvalLen\" type=\"u\" access=\"read\"/> "
     "   <property name=\"maxScriptLen\" type=\"u\" access=\"read\"/> "
+    "   <property name=\"heapStats\" type=\"a(yqqqquu)\" access=\"read\"/> "
+    "   <property name=\"loopStats\" type=\"a{su}\" access=\"read\"/> "
     "   <method name=\"eval\"> "
     "     <arg name=\"script\" type=\"ay\" direction=\"in\"/> "
     "     <arg name=\"status\" type=\"y\" direction=\"out\"/> "
@@ -1331,6 +1333,86 @@ int8_t AJS_Console::LockdownConsole(void)
     return 1;
 }
 
+QStatus AJS_Console::HeapStats(void)
+{
+    QStatus status;
+    MsgArg value;
+    MsgArg* entries;
+    size_t num;
+    uint32_t totalUse = 0;
+    uint32_t totalHwm = 0;
+    uint32_t totalSize = 0;
+
+    status = proxy->GetProperty("org.allseen.scriptConsole", "heapStats", value);
+    if (status != ER_OK) {
+        QCC_SyncPrintf("GetProperty(\"heapStats\") failed, status = %u\n", status);
+        return status;
+    }
+    status = value.Get("a(yqqqquu)", &num, &entries);
+    if (status != ER_OK) {
+        QCC_LogError(status, ("Unexpected heapStats signature\n"));
+        return status;
+    }
+    if (num == 0) {
+        Print("Target is not using pool allocation\n");
+        return ER_OK;
+    }
+    Print("heap   size  entries   in-use  high-water     failed   borrowed\n");
+    for (size_t i = 0; i < num; ++i) {
+        uint8_t heap;
+        uint16_t size;
+        uint16_t count;
+        uint16_t use;
+        uint16_t hwm;
+        uint32_t failed;
+        uint32_t borrowed;
+        entries[i].Get("(yqqqquu)", &heap, &size, &count, &use, &hwm, &failed, &borrowed);
+        Print("%4u %6u %8u %8u %11u %10u %10u%s\n", heap, size, count, use, hwm, failed, borrowed, (hwm == count) ? " *" : "");
+        totalUse += use * size;
+        totalHwm += hwm * size;
+        totalSize += count * size;
+    }
+    Print("in-use %u bytes, high-water %u bytes, pool total %u bytes (* = pool exhausted)\n", totalUse, totalHwm, totalSize);
+    return ER_OK;
+}
+
+QStatus AJS_Console::LoopStats(void)
+{
+    QStatus status;
+    MsgArg value;
+    MsgArg* entries;
+    size_t num;
+    uint32_t batches = 0;
+    uint32_t messages = 0;
+
+    status = proxy->GetProperty("org.allseen.scriptConsole", "loopStats", value);
+    if (status != ER_OK) {
+        QCC_SyncPrintf("GetProperty(\"loopStats\") failed, status = %u\n", status);
+        return status;
+    }
+    status = value.Get("a{su}", &num, &entries);
+    if (status != ER_OK) {
+        QCC_LogError(status, ("Unexpected loopStats signature\n"));
+        return status;
+    }
+    for (size_t i = 0; i < num; ++i) {
+        const char* name;
+        uint32_t count;
+        entries[i].Get("{su}", &name, &count);
+        Print("%-24s %10u\n", name, count);
+        if (strcmp(name, "batches") == 0) {
+            batches = count;
+        } else if (strcmp(name, "messages") == 0) {
+            messages = count;
+        }
+    }
+    if (batches) {
+        uint64_t avg = ((uint64_t)messages * 100) / batches;
+        Print("average batch size %u.%02u\n", (uint32_t)(avg / 100), (uint32_t)(avg % 100));
+    }
+    return ER_OK;
+}
+
 void AJS_Console::BusDisconnected()
 {
     QCC_SyncPrintf("SessionLost. Bus has been disconnected.\n");
@@ -123,6 +123,20 @@ class AJS_Console : public ajn::BusListener, public ajn::SessionListener, public
 
     int8_t LockdownConsole(void);
 
+    /**
+     * Fetch the heap pool statistics from the target and print them
+     *
+     * @return ER_OK if the statistics were fetched
+     */
+    QStatus HeapStats(void);
+
+    /**
+     * Fetch the message loop counters from the target and print them
+     *
+     * @return ER_OK if the counters were fetched
+     */
+    QStatus LoopStats(void);
+
     void SessionLost(ajn::SessionId sessionId, SessionLostReason reason);
 
     virtual void BusDisconnected();
@@ -185,6 +185,14 @@ int main(int argc, char** argv)
                     ajsConsole->StopDebugger();
                     continue;
                 }
+                if (input == "$heap") {
+                    ajsConsole->HeapStats();
+                    continue;
+                }
+                if (input == "$loop") {
+                    ajsConsole->LoopStats();
+                    continue;
+                }
                 if (strncmp(input.c_str(), "$install", 8) == 0) {
                     const char* fname;
                     uint8_t* newscript;
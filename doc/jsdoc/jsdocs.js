@@ -550,6 +550,17 @@ var AJ = {
      * }
      */
     onDetach: function() {},
+    /**
+     * Callback for when the heap is running low on memory. This is called between messages when a
+     * heap pool drops below its low-watermark, the garbage collector runs after the callback returns.
+     *
+     * @example
+     * AJ.onLowMemory = function() {
+     *     // Drop cached data so it can be garbage collected
+     *     cache = {};
+     * }
+     */
+    onLowMemory: function() {},
     /**
      * Callback when a peer connects to an announced/advertised service. Return true or
      * false to accept or deny the connection.
@@ -586,12 +597,20 @@ var AJ = {
      * as 'member' (signal name), 'sender', 'iface', 'path', and a boolean 'fromSelf' which
      * tells you if the signal was sent from yourself.
      *
+     * If the reply cannot be sent before the callback returns call this.defer(timeout) which
+     * returns a token with reply() and errorReply() functions for sending the reply later. An error
+     * reply is sent if the token has not been replied to within timeout milliseconds, the default
+     * is AJ.config.replyTimeout.
+     *
      * @param arg       Argument to the method call
      *
      * @example
      * AJ.onMethodCall = function(arg) {
      *     if (this.member == 'my_method') {
      *         this.reply('success');
+     *     } else if (this.member == 'my_slow_method') {
+     *         var token = this.defer(5000);
+     *         setTimeout(function() { token.reply('done'); }, 1000);
      *     } else {
      *         throw('rejected');
      *     }
@@ -623,6 +642,42 @@ var AJ = {
      * }
      */
     onSignal: function() {},
+    /**
+     * Registers a handler for a specific signal or method call. Handlers registered with AJ.on()
+     * are dispatched directly from the message id without going through AJ.onSignal or
+     * AJ.onMethodCall, which are only called for members that have no registered handler. As with
+     * those callbacks 'this' is the message object.
+     *
+     * @param {String} iface     Name of the interface the member belongs to
+     * @param {String} member    Name of the signal or method
+     * @param {Function} handler Function to call when the signal or method call is received, pass
+     *                           null to remove a previously registered handler
+     *
+     * @example
+     * AJ.on('org.alljoyn.alljoyn_test', 'my_signal', function(arg) {
+     *     print('Signal received ' + arg);
+     * });
+     *
+     * AJ.on('org.alljoyn.alljoyn_test', 'my_ping', function(arg) {
+     *     this.reply(arg);
+     * });
+     */
+    on: function(iface, member, handler) {},
+    /**
+     * Tells AllJoyn.js that property values have changed. When AJ.config.cacheGetAll is set the
+     * cached replies to GetAll are discarded for the interface so the next GetAll calls
+     * onPropGetAll. Replies are cached per object path and interface, and the same cached reply is
+     * sent to every caller.
+     *
+     * @param {String} iface     Interface the properties belong to, if omitted the cached replies
+     *                           for all interfaces are discarded
+     * @param {String} path      Object path the properties belong to, if omitted the cached replies
+     *                           for all objects are discarded
+     *
+     * @example
+     * AJ.propertyChanged('org.alljoyn.example.Dimmer', '/dimmer/2');
+     */
+    propertyChanged: function(iface, path) {},
     /**
      * Callback for a peer getting a services property. In this function you need to reply with the property value the peer has asked for
      *
@@ -842,19 +897,27 @@ var AJ = {
     offboard: function() {}
 };
 /**
- * Set a function to be called at a millisecond interval
+ * Set a function to be called at a millisecond interval. Intervals are scheduled from when the
+ * interval was set so the calls do not drift if the function is called late. The overrun policy
+ * determines what happens if one or more intervals are missed because the script was busy:
+ * 'skip' (the default) skips the missed intervals, 'once' also skips the missed intervals but
+ * passes the number of intervals missed to the function, 'burst' calls the function once for each
+ * missed interval until it has caught up.
  *
  * @namespace
  * @type {function}
  * @method
  * @param {function} func                   Function to be called
  * @param {number} interval                 Interval to call the function at
+ * @param {string} [overrun]                Overrun policy 'skip', 'once', or 'burst'
  * @return {Context}                        A context representing the setInterval call
  *
  * @example
  * var i = setInterval(function() { print('Hello'); }, 1000);
+ *
+ * var s = setInterval(function(missed) { if (missed) { print('Missed ' + missed + ' samples'); } }, 100, 'once');
  */
-function setInterval(func, interval) {}
+function setInterval(func, interval, overrun) {}
 /**
  * Clear a previously set interval.
  *
@@ -937,6 +1000,38 @@ function setTimeout(func, timeout) {}
  * var i = setInterval(increment(t), 10);
  */
 function clearTimeout(timeoutCtx) {}
+/**
+ * Queue a function to be called as soon as the current callback returns. Queued functions are
+ * called in the order they were queued before the next message is received. This is cheaper than
+ * setTimeout(func, 0) and can be used to split up long running work.
+ *
+ * @namespace
+ * @type {function}
+ * @method
+ * @param {function} func                   Function to be called
+ *
+ * @example
+ * var items = [];
+ * function processSome() {
+ *     var n = 10;
+ *     while (items.length && n--) {
+ *         process(items.shift());
+ *     }
+ *     if (items.length) {
+ *         setImmediate(processSome);
+ *     }
+ * }
+ */
+function setImmediate(func) {}
+/**
+ * Same as setImmediate()
+ *
+ * @namespace
+ * @type {function}
+ * @method
+ * @param {function} func                   Function to be called
+ */
+function queueMicrotask(func) {}
 /**
  * Method object. This can only be created after a Service object is available by using
  * the 'method' function of the Service object.
@@ -954,12 +1049,47 @@ var Method = {
      * @param data          Raw data to send as the method arguments
      */
     call: function(data) {},
+    /**
+     * Call a method that has a single byte array argument (signature "ay") streaming the data into
+     * the message so the byte array can be larger than the transmit buffer. The data is either a
+     * buffer or the total length followed by a function that is called to read the data in chunks.
+     *
+     * The partial message owns the transmit buffer while the read function runs so nothing else
+     * can be sent. Functions that send a message, such as send(), call(), reply(), getProp(),
+     * AJ.addMatch() and AJ.findService(), throw if they are called from a read function, and
+     * print() and alert() output is printed locally instead of being sent to the console. If the
+     * read function throws or returns an empty or oversized buffer the rest of the data is sent as
+     * zeros to keep the message intact and then an error is thrown.
+     *
+     * @param data          Buffer or Duktape.Buffer to send or the total length of the data
+     * @param {function} read  Called with the offset and remaining length and returns a buffer with
+     *                         the next chunk of data
+     *
+     * @example
+     * svc.method('upload').callStream(4096, function(offset, remaining) {
+     *     return readBlock(offset, Math.min(remaining, 512));
+     * }).onReply = function() {
+     *     print('Upload complete');
+     * }
+     */
+    callStream: function(data, read) {},
     /**
      * Callback thats called when the method reply is received
      *
      * @param arg           Argument data in the method reply
      */
-    onReply: function(arg) {}
+    onReply: function(arg) {},
+    /**
+     * Callback thats called if no reply is received before the call times out. The call timeout
+     * is the method's timeout property or AJ.config.callTimeout. If there is no onTimeout
+     * callback onReply is called with the timeout error.
+     *
+     * @example
+     * var reply = svc.method('my_method').call();
+     * reply.onReply = function(arg) { print(arg); }
+     * reply.onTimeout = function() { print('no reply'); }
+     */
+    onTimeout: function() {}
 }
 /**
  * Signal object. This can only be created after a Service object is available by using
@@ -978,7 +1108,24 @@ var Signal = {
      *
      * @param data          Raw data to send as the signal payload
      */
-    send: function(data) {}
+    send: function(data) {},
+    /**
+     * Send a signal that has a single byte array argument (signature "ay") streaming the data into
+     * the message so the byte array can be larger than the transmit buffer. The data is either a
+     * buffer or the total length followed by a function that is called to read the data in chunks.
+     *
+     * The partial message owns the transmit buffer while the read function runs so nothing else
+     * can be sent. Functions that send a message, such as send(), call(), reply(), getProp(),
+     * AJ.addMatch() and AJ.findService(), throw if they are called from a read function, and
+     * print() and alert() output is printed locally instead of being sent to the console. If the
+     * read function throws or returns an empty or oversized buffer the rest of the data is sent as
+     * zeros to keep the message intact and then an error is thrown.
+     *
+     * @param data          Buffer or Duktape.Buffer to send or the total length of the data
+     * @param {function} read  Called with the offset and remaining length and returns a buffer with
+     *                         the next chunk of data
+     */
+    sendStream: function(data, read) {}
 }
 /**
  * Service object. A Service object is made available through a find service method call
@@ -998,7 +1145,9 @@ var Signal = {
  */
 var Service = {
    /**
-    * Used to create a method object on this service
+    * Used to create a method object on this service. If more than one of the service's interfaces
+    * define a method with this name the interface must be given as { name:'interface-name' },
+    * otherwise a ReferenceError is thrown.
     *
     * @param {String} name          Name of the method
     * @return {Method}              Method object
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *    Copyright (c) Open Connectivity Foundation (OCF), AllJoyn Open Source
+ *    Project (AJOSP) Contributors and others.
+ *    
+ *    SPDX-License-Identifier: Apache-2.0
+ *    
+ *    All rights reserved. This program and the accompanying materials are
+ *    made available under the terms of the Apache License, Version 2.0
+ *    which accompanies this distribution, and is available at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *    
+ *    Copyright (c) Open Connectivity Foundation and Contributors to AllSeen
+ *    Alliance. All rights reserved.
+ *    
+ *    Permission to use, copy, modify, and/or distribute this software for
+ *    any purpose with or without fee is hereby granted, provided that the
+ *    above copyright notice and this permission notice appear in all
+ *    copies.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ *    WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ *    WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ *    AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ *    DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ *    PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ *    TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ *    PERFORMANCE OF THIS SOFTWARE.
+******************************************************************************/
+
+/*
+ * Allocation microbenchmark. Runs a fixed mix of object, string, array and buffer churn which
+ * exercises the pool allocator through the Duktape allocation, reallocation and garbage collection
+ * paths. Run the same script before and after a heap change and compare the reported rates.
+ */
+var ROUNDS = 20;
+var ITERATIONS = 2000;
+
+var round = 0;
+var total = 0;
+
+function churn()
+{
+    var keep = [];
+    var i;
+    for (i = 0; i < ITERATIONS; ++i) {
+        var obj = { id:i, name:'obj' + i };
+        var arr = [i, i + 1, i + 2];
+        var str = obj.name + ':' + arr.join(',');
+        var buf = Duktape.Buffer(16 + (i & 0xFF));
+        /*
+         * Grow an array to force reallocations and keep a small working set alive
+         */
+        arr.push(str, buf);
+        if ((i & 7) == 0) {
+            keep.push(obj);
+        }
+    }
+    return keep.length;
+}
+
+function runRound()
+{
+    var start = Date.now();
+    churn();
+    total += Date.now() - start;
+    if (++round < ROUNDS) {
+        setTimeout(runRound, 0);
+    } else {
+        var ops = ROUNDS * ITERATIONS;
+        print('heap_bench: ', ops, ' iterations in ', total, 'ms ', Math.round(ops * 1000 / Math.max(total, 1)), ' iterations/sec');
+    }
+}
+
+setTimeout(runRound, 0);
@@ -0,0 +1,121 @@
+/******************************************************************************
+ *    Copyright (c) Open Connectivity Foundation (OCF), AllJoyn Open Source
+ *    Project (AJOSP) Contributors and others.
+ *    
+ *    SPDX-License-Identifier: Apache-2.0
+ *    
+ *    All rights reserved. This program and the accompanying materials are
+ *    made available under the terms of the Apache License, Version 2.0
+ *    which accompanies this distribution, and is available at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *    
+ *    Copyright (c) Open Connectivity Foundation and Contributors to AllSeen
+ *    Alliance. All rights reserved.
+ *    
+ *    Permission to use, copy, modify, and/or distribute this software for
+ *    any purpose with or without fee is hereby granted, provided that the
+ *    above copyright notice and this permission notice appear in all
+ *    copies.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ *    WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ *    WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ *    AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ *    DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ *    PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ *    TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ *    PERFORMANCE OF THIS SOFTWARE.
+******************************************************************************/
+
+/*
+ * Pointer compression test. Builds a graph of objects, strings and buffers with sizes spread over
+ * all of the heap pools so that with multiple heaps every heap holds blocks that reference blocks
+ * in the other heaps. The graph is verified after each garbage collection, a corrupted compressed
+ * pointer shows up as a bad value or a crash. On Linux build with POOL_MALLOC=on and
+ * define=AJS_NUM_HEAPS=4 to split the pools over four heaps.
+ */
+var SIZES = [1, 8, 20, 40, 60, 90, 120, 250, 500, 1000, 2000, 2900, 4000, 12000];
+var ROUNDS = 10;
+
+var nodes = [];
+var round = 0;
+var errors = 0;
+
+function pattern(n, len)
+{
+    var s = '';
+    while (s.length < len) {
+        s += String.fromCharCode(0x41 + ((n + s.length) % 26));
+    }
+    return s;
+}
+
+function makeNode(n)
+{
+    var len = SIZES[n % SIZES.length];
+    var buf = Duktape.Buffer(len);
+    var i;
+    for (i = 0; i < len; ++i) {
+        buf[i] = (n + i) & 0xFF;
+    }
+    return { n:n, str:pattern(n, len), buf:buf, next:nodes[n - 1], arr:new Array(n % 40) };
+}
+
+function checkNode(node)
+{
+    var len = SIZES[node.n % SIZES.length];
+    var i;
+    if (node.str !== pattern(node.n, len) || node.buf.length !== len || node.arr.length !== (node.n % 40)) {
+        return false;
+    }
+    for (i = 0; i < len; ++i) {
+        if (node.buf[i] !== ((node.n + i) & 0xFF)) {
+            return false;
+        }
+    }
+    return !node.next || node.next.n === node.n - 1;
+}
+
+function fill()
+{
+    var n;
+    for (n = 0; n < 200; ++n) {
+        if (!nodes[n]) {
+            try {
+                nodes[n] = makeNode(n);
+            } catch (e) {
+                /* Heap is full, leave the rest of the graph empty */
+                break;
+            }
+        }
+    }
+}
+
+function runRound()
+{
+    var n;
+    fill();
+    Duktape.gc();
+    for (n = 0; n < nodes.length; ++n) {
+        if (nodes[n] && !checkNode(nodes[n])) {
+            print('heap_ptr16_test: node ', n, ' is corrupt');
+            ++errors;
+        }
+    }
+    /*
+     * Drop a different subset of the graph each round so blocks are recycled across the heaps
+     */
+    for (n = round % 3; n < nodes.length; n += 3) {
+        nodes[n] = undefined;
+        if (nodes[n + 1]) {
+            nodes[n + 1].next = undefined;
+        }
+    }
+    if (++round < ROUNDS) {
+        setTimeout(runRound, 0);
+    } else {
+        print('heap_ptr16_test: ', errors ? 'FAILED' : 'PASSED');
+    }
+}
+
+setTimeout(runRound, 0);
@@ -0,0 +1,63 @@
+/******************************************************************************
+ *    Copyright (c) Open Connectivity Foundation (OCF), AllJoyn Open Source
+ *    Project (AJOSP) Contributors and others.
+ *    
+ *    SPDX-License-Identifier: Apache-2.0
+ *    
+ *    All rights reserved. This program and the accompanying materials are
+ *    made available under the terms of the Apache License, Version 2.0
+ *    which accompanies this distribution, and is available at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *    
+ *    Copyright (c) Open Connectivity Foundation and Contributors to AllSeen
+ *    Alliance. All rights reserved.
+ *    
+ *    Permission to use, copy, modify, and/or distribute this software for
+ *    any purpose with or without fee is hereby granted, provided that the
+ *    above copyright notice and this permission notice appear in all
+ *    copies.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ *    WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ *    WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ *    AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ *    DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ *    PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ *    TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ *    PERFORMANCE OF THIS SOFTWARE.
+******************************************************************************/
+
+/*
+ * Discovery benchmark, run with several instances of js/proxy_bench_service.js on other devices.
+ * Reports the time from attaching to the bus until each service is found and the time until PEERS
+ * services have been found. Run with different values of AJ.config.maxJoins and compare the times,
+ * the $loop console command shows the join round trip times.
+ */
+var AJ = require('AllJoyn');
+
+var PEERS = 10;
+
+AJ.interfaceDefinition["org.alljoyn.proxy_bench"] =
+{
+    ping:{ type:AJ.METHOD, args:["u"], returns:["u"] }
+};
+
+var start;
+var found = 0;
+
+AJ.onAttach = function()
+{
+    start = Date.now();
+    AJ.findService('org.alljoyn.proxy_bench', function(svc) {
+        ++found;
+        print('join_bench: ', svc.dest, ' found after ', Date.now() - start, 'ms');
+        if (found == PEERS) {
+            print('join_bench: ', PEERS, ' services found in ', Date.now() - start, 'ms');
+        }
+    });
+}
+
+AJ.onDetach = function()
+{
+    print("AJ.onDetach");
+}
@@ -0,0 +1,99 @@
+/******************************************************************************
+ *    Copyright (c) Open Connectivity Foundation (OCF), AllJoyn Open Source
+ *    Project (AJOSP) Contributors and others.
+ *    
+ *    SPDX-License-Identifier: Apache-2.0
+ *    
+ *    All rights reserved. This program and the accompanying materials are
+ *    made available under the terms of the Apache License, Version 2.0
+ *    which accompanies this distribution, and is available at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *    
+ *    Copyright (c) Open Connectivity Foundation and Contributors to AllSeen
+ *    Alliance. All rights reserved.
+ *    
+ *    Permission to use, copy, modify, and/or distribute this software for
+ *    any purpose with or without fee is hereby granted, provided that the
+ *    above copyright notice and this permission notice appear in all
+ *    copies.
+ *    
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ *    WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ *    WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ *    AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+ *    DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+ *    PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ *    TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ *    PERFORMANCE OF THIS SOFTWARE.
+******************************************************************************/
+/*
+ * Method call microbenchmark, run with js/proxy_bench_service.js on a second instance. Each round
+ * makes CALLS sequential calls to the ping method, first looking the method up with svc.method()
+ * before every call and then reusing a single method object. Run the same script before and after a
+ * change to the proxy path and compare the reported rates.
+ */
+var AJ = require('AllJoyn');
+
+var CALLS = 500;
+
+AJ.interfaceDefinition["org.alljoyn.proxy_bench"] =
+{
+    ping:{ type:AJ.METHOD, args:["u"], returns:["u"] }
+};
+
+function report(name, start)
+{
+    var ms = Math.max(Date.now() - start, 1);
+    print('proxy_bench: ', name, ' ', CALLS, ' calls in ', ms, 'ms ', Math.round(CALLS * 1000 / ms), ' calls/sec');
+}
+
+function lookupEach(svc, done)
+{
+    var start = Date.now();
+    var n = 0;
+    function next() {
+        svc.method('ping').call(n).onReply = function(val) {
+            if (++n < CALLS) {
+                next();
+            } else {
+                report('lookup each call', start);
+                done();
+            }
+        }
+    }
+    next();
+}
+
+function reuse(svc, done)
+{
+    var ping = svc.method('ping');
+    var start = Date.now();
+    var n = 0;
+    function next() {
+        ping.call(n).onReply = function(val) {
+            if (++n < CALLS) {
+                next();
+            } else {
+                report('reused proxy', start);
+                done();
+            }
+        }
+    }
+    next();
+}
+
+AJ.onAttach = function()
+{
+    AJ.findService('org.alljoyn.proxy_bench', function(svc) {
+        lookupEach(svc, function() {
+            reuse(svc, function() {
+                print('proxy_bench: done');
+            });
+        });
+    });
+}
+
+AJ.onDetach = function()
+{
+    print("AJ.onDetach");
+}
@@ -351,7 +351,16 @@ static const duk_number_list_entry AJ_constants[] = {
 static const duk_number_list_entry AJ_config_constants[] = {
     { "linkTimeout",    10000 },
     { "callTimeout",    10000 },
+    { "replyTimeout",   10000 },
+    { "maxCalls",          32 },
     { "minProtoVersion",   12 },
+    { "batchSize",          1 },
+    { "batchTime",         10 },
+    { "lazyMessages",       0 },
+    { "cacheGetAll",        0 },
+    { "maxJoins",           4 },
+    { "joinBackoff",     1000 },
+    { "joinTimeout",    30000 },
     { NULL }
 };
 
@@ -121,6 +121,7 @@ typedef struct {
     int32_t msgId;
     int32_t session;
     uint8_t secure;
+    uint8_t sends;     /* Counts sends up to 2, the marshalling plan is compiled on the second send */
     char dest[1];
 } AJS_MsgInfo;
 
@@ -220,6 +221,21 @@ AJ_Status AJS_InitTables(duk_context* ctx, duk_idx_t ajIdx);
  */
 void AJS_ResetTables(duk_context* ctx);
 
+/**
+ * Push the handler registered by AJ.on() for a message onto the duktape stack.
+ *
+ * @param ctx    An opaque pointer to a duktape context structure
+ * @param msgId  The message id of a received signal or method call
+ *
+ * @return  TRUE if a handler was pushed, FALSE if there is no handler for this message.
+ */
+uint8_t AJS_PushMemberHandler(duk_context* ctx, uint32_t msgId);
+
+/**
+ * Called when the handlers registered by AJ.on() have changed
+ */
+void AJS_MemberHandlersChanged(void);
+
 /**
  * Queue a PolicyChange notification
  */
@@ -237,6 +253,74 @@ void AJS_QueueNotifPolicyChanged();
  */
 AJ_Status AJS_MessageLoop(duk_context* ctx, AJ_BusAttachment* bus, duk_idx_t ajIdx);
 
+/**
+ * Message loop statistics. A batch is the messages received between housekeeping passes, the
+ * batch size is set by AJ.config.batchSize and AJ.config.batchTime.
+ */
+typedef struct _AJS_MsgLoopStats {
+    uint32_t batches;  /* Number of batches of messages received */
+    uint32_t messages; /* Number of messages received */
+    uint32_t maxBatch; /* Largest number of messages received in one batch */
+} AJS_MsgLoopStats;
+
+/**
+ * Get the message loop statistics
+ *
+ * @param stats  Returns the message loop statistics
+ */
+void AJS_GetMsgLoopStats(AJS_MsgLoopStats* stats);
+
+/**
+ * Method call statistics for calls that expect a reply
+ */
+typedef struct _AJS_CallStats {
+    uint32_t outstanding; /* Number of calls waiting for a reply */
+    uint32_t completed;   /* Number of calls that received a reply */
+    uint32_t timedOut;    /* Number of calls that timed out */
+    uint32_t rejected;    /* Number of calls rejected because AJ.config.maxCalls was reached */
+} AJS_CallStats;
+
+/**
+ * Get the method call statistics
+ *
+ * @param stats  Returns the method call statistics
+ */
+void AJS_GetCallStats(AJS_CallStats* stats);
+
+/**
+ * Session join and announcement statistics
+ */
+typedef struct _AJS_SessionStats {
+    uint32_t annoDropped;   /* Number of unchanged re-announcements that were dropped */
+    uint32_t joinsStarted;  /* Number of JOIN_SESSION calls sent */
+    uint32_t joinsRetried;  /* Number of failed joins that were requeued */
+    uint32_t joinsFailed;   /* Number of peers given up on after AJS_MAX_JOIN_ATTEMPTS failed joins */
+    uint32_t joinsTimedOut; /* Number of joins that were failed because there was no reply */
+    uint32_t joinsQueued;   /* Number of joins waiting to be started */
+    uint32_t joinsInFlight; /* Number of joins waiting for a reply */
+    uint32_t joinTimeAvg;   /* Average time in milliseconds from sending a join to receiving the reply */
+    uint32_t joinTimeMax;   /* Longest time in milliseconds from sending a join to receiving the reply */
+    uint32_t allJoinedTime; /* Milliseconds from startup until the last time no joins were queued or in progress */
+    uint32_t allocFailed;   /* Number of peers that were ignored because the session table was full */
+} AJS_SessionStats;
+
+/**
+ * Get the session join and announcement statistics
+ *
+ * @param stats  Returns the session statistics
+ */
+void AJS_GetSessionStats(AJS_SessionStats* stats);
+
+/**
+ * Configures the session join scheduler
+ *
+ * @param maxJoins  Maximum number of joins waiting for a reply, 0 for no limit
+ * @param backoff   Delay in milliseconds before the first retry of a failed join, the delay doubles
+ *                  for each further retry.
+ * @param timeout   Time in milliseconds to wait for a join reply before the join is failed
+ */
+void AJS_SetJoinSchedule(uint8_t maxJoins, uint32_t backoff, uint32_t timeout);
+
 /**
  * Entry point for AllJoyn
  *
@@ -328,6 +412,15 @@ int AJS_MethodCallReply(duk_context* ctx);
  */
 int AJS_MethodCallError(duk_context* ctx);
 
+/**
+ * Function registered on method call for deferring the reply. Returns a token object with reply
+ * and errorReply functions that can be called after the method handler has returned. An error
+ * reply is sent automatically if the token has not been replied to before the timeout expires.
+ *
+ * @param ctx     An opaque pointer to a duktape context structure
+ */
+int AJS_MethodCallDefer(duk_context* ctx);
+
 /**
  * Register native 'C' functions for target-specific I/O
  *
@@ -372,10 +465,43 @@ AJ_Status AJS_RegisterTimerFuncs(duk_context* ctx);
  * Process any timer callbacks and return the number of milliseconds until the deadline.
  *
  * @param ctx       An opaque pointer to a duktape context structure
- * @param clock     Tracks the elapsed time between calls to this function
  * @param deadline  Returns the deadline for calling this function again.
  */
-AJ_Status AJS_RunTimers(duk_context* ctx, AJ_Time* clock, uint32_t* deadline);
+AJ_Status AJS_RunTimers(duk_context* ctx, uint32_t* deadline);
+
+/**
+ * Register a one-shot timer for the function on the top of the stack. The function is popped.
+ *
+ * @param ctx     An opaque pointer to a duktape context structure
+ * @param ms      The timeout in milliseconds
+ *
+ * @return  The timer id
+ */
+int32_t AJS_SetTimeout(duk_context* ctx, uint32_t ms);
+
+/**
+ * Cancel a one-shot timer registered by AJS_SetTimeout. It is not an error if the timer has
+ * already run.
+ *
+ * @param ctx     An opaque pointer to a duktape context structure
+ * @param id      The timer id returned by AJS_SetTimeout
+ */
+void AJS_ClearTimeout(duk_context* ctx, int32_t id);
+
+/**
+ * Call the functions queued by setImmediate or queueMicrotask. Functions queued while these
+ * functions are running are not called until the next time this function is called.
+ *
+ * @param ctx     An opaque pointer to a duktape context structure
+ */
+AJ_Status AJS_RunImmediate(duk_context* ctx);
+
+/**
+ * Indicates if there are functions queued by setImmediate or queueMicrotask
+ *
+ * @return  TRUE if AJS_RunImmediate should be called
+ */
+uint8_t AJS_ImmediatePending(void);
 
 #define AJS_APP_PORT            2
 
@@ -415,9 +541,12 @@ AJ_Status AJS_ConsoleInit(AJ_BusAttachment* aj);
 void AJS_ConsoleTerminate();
 
 /**
- * Services any pending sessions to join (when authentication is pending)
+ * Starts queued session joins that are due and calls the service callbacks for peers that have
+ * finished authenticating. Returns immediately if no peers are waiting.
+ *
+ * @param msgTO  The message loop timeout, reduced if a queued join is due sooner
  */
-AJ_Status AJS_ServiceSessions(duk_context* ctx);
+AJ_Status AJS_ServiceSessions(duk_context* ctx, uint32_t* msgTO);
 
 /**
  * Set the object list for About
@@ -451,6 +580,17 @@ void AJS_AuthRegisterObject(const char* path, uint8_t index);
  */
 AJ_Status AJS_AboutAnnouncement(duk_context* ctx, AJ_Message* msg);
 
+/**
+ * Register or remove the service callback for an interface. The service callback is called with a
+ * service object when an announcement for the interface is received.
+ *
+ * @param ctx    An opaque pointer to a duktape context structure
+ * @param iface  The interface name
+ * @param cbIdx  Stack index of the callback function, if this is not a function the service
+ *               callback for the interface is removed
+ */
+void AJS_SetServiceCallback(duk_context* ctx, const char* iface, duk_idx_t cbIdx);
+
 /**
  * Handle an incoming FoundAdvertisedName signal
  *
@@ -507,6 +647,33 @@ int AJS_MarshalMethodCall(duk_context* ctx);
  */
 int AJS_MarshalSignal(duk_context* ctx);
 
+/**
+ * Native functions called from JavaScript to send a method call or signal message with a single
+ * byte array argument that is streamed into the message in chunks. This allows byte arrays that
+ * are larger than the transmit buffer to be sent. The function is called with either a buffer or a
+ * total length and a function that is called with an offset and remaining length and returns the
+ * next chunk of data.
+ *
+ * @param ctx  An opaque pointer to a duktape context structure
+ */
+int AJS_MarshalMethodCallStream(duk_context* ctx);
+int AJS_MarshalSignalStream(duk_context* ctx);
+
+/**
+ * Returns TRUE while a stream read function is running. The partially delivered stream message owns
+ * the transmit buffer so nothing else can be sent on the bus until the stream is complete.
+ */
+uint8_t AJS_IsStreaming(void);
+
+/**
+ * Throws an error if called while a stream read function is running. Called by all native
+ * functions that send a message.
+ *
+ * @param ctx   An opaque pointer to a duktape context structure
+ * @param func  The function name for the error message
+ */
+void AJS_CheckNotStreaming(duk_context* ctx, const char* func);
+
 /**
  * Unmarshals a message from C to JavaScript pushing the resultant JavaScript object onto the
  * duktape stack. Returns the index of the message object.
@@ -519,6 +686,16 @@ int AJS_MarshalSignal(duk_context* ctx);
  */
 duk_idx_t AJS_UnmarshalMessage(duk_context* ctx, AJ_Message* msg, uint8_t accessor);
 
+/**
+ * Selects how AJS_UnmarshalMessage builds message objects. In lazy mode the header fields are held
+ * in a fixed buffer and exposed through getters on a shared prototype so the strings are only
+ * created if the script reads them.
+ *
+ * @param enable  TRUE to build lazy message objects, FALSE to copy the header fields into each
+ *                message object.
+ */
+void AJS_SetLazyMessages(uint8_t enable);
+
 /**
  * Unmarshals message arguments from C to JavaScript pushing the resultant JavaScript objects onto
  * the duktape stack.
@@ -556,6 +733,66 @@ AJ_Status AJS_UnmarshalPropArgs(duk_context* ctx, AJ_Message* msg, uint8_t acces
  */
 char AJS_GetPropMemberAccess(duk_context* ctx, duk_idx_t idx);
 
+/**
+ * Descriptor for a readable property built from the interface definitions
+ */
+typedef struct {
+    const char* name;  /* Property name, NULL terminates the descriptors for an interface */
+    const char* sig;   /* Property signature */
+} AJS_PropDesc;
+
+/**
+ * Get the descriptors for the readable properties of an interface. These are built when the tables
+ * are initialized.
+ *
+ * @param iface  The interface name
+ *
+ * @return  Returns the descriptors terminated by an entry with a NULL name or NULL if the interface
+ *          is not defined.
+ */
+const AJS_PropDesc* AJS_GetPropertyDescriptors(const char* iface);
+
+/**
+ * Look up the interface that defines a member in the member index that is built when the tables are
+ * initialized.
+ *
+ * @param ctx     An opaque pointer to a duktape context structure
+ * @param member  The member name
+ *
+ * @return  Returns the interface name or NULL if the member is defined on more than one interface,
+ *          is not defined, or the tables have not been initialized.
+ */
+const char* AJS_GetMemberInterface(duk_context* ctx, const char* member);
+
+/**
+ * Enables caching of the marshalled reply to a GetAll call. When the cache is enabled the script
+ * must call AJ.propertyChanged() when property values change so the cached reply is discarded.
+ *
+ * @param enable  TRUE to enable caching
+ */
+void AJS_EnableGetAllCache(uint8_t enable);
+
+/**
+ * Reply to a GetAll call from the cache. Replies are cached per object path and interface.
+ *
+ * @param ctx    An opaque pointer to a duktape context structure
+ * @param msg    The GetAll method call
+ * @param iface  The interface the properties were requested for
+ *
+ * @return  Returns TRUE if the reply was sent from the cache, FALSE if there is no cached reply or
+ *          the cached reply could not be marshalled. Replies to encrypted calls are never cached.
+ */
+uint8_t AJS_ReplyCachedProperties(duk_context* ctx, AJ_Message* msg, const char* iface);
+
+/**
+ * Discard cached GetAll replies.
+ *
+ * @param ctx    An opaque pointer to a duktape context structure
+ * @param iface  The interface that changed or NULL for all interfaces
+ * @param path   The object that changed or NULL for all objects
+ */
+void AJS_InvalidatePropertyCache(duk_context* ctx, const char* iface, const char* path);
+
 /**
  * This function is used to by all native functions that make a method call to push a reply object
  * that can be used to register a callback function to be called when a method reply is received.
@@ -565,6 +802,36 @@ char AJS_GetPropMemberAccess(duk_context* ctx, duk_idx_t idx);
  */
 void AJS_PushReplyObject(duk_context* ctx, uint32_t replySerial);
 
+/**
+ * Pushes a reply object for a method call with a reply that is handled internally and is never
+ * passed to AJS_PushReplyHandler, for example AddMatch and RemoveMatch. The reply object is not
+ * registered for a reply, has no timeout, and is not counted as an outstanding call.
+ *
+ * @param ctx         An opaque pointer to a duktape context structure
+ * @param replySerial The method call serial number
+ */
+void AJS_PushBareReplyObject(duk_context* ctx, uint32_t replySerial);
+
+/**
+ * Called when a method reply or error is received. Removes the reply object for the call and
+ * pushes the onReply function registered on the reply object, or undefined if there is no onReply
+ * function. A timeout error is passed to the onTimeout function if one is registered on the reply
+ * object.
+ *
+ * @param ctx  An opaque pointer to a duktape context structure
+ * @param msg  The method reply or error message
+ *
+ * @return  FALSE if the reply was handled and nothing was pushed.
+ */
+uint8_t AJS_PushReplyHandler(duk_context* ctx, AJ_Message* msg);
+
+/**
+ * Creates the table that holds the reply objects for calls that are waiting for a reply
+ *
+ * @param ctx  An opaque pointer to a duktape context structure
+ */
+void AJS_InitReplyTable(duk_context* ctx);
+
 /**
  * @param ctx    An opaque pointer to a duktape context structure
  * @param alert  Set this to 1 for an alert, 0 for print. Print and alert correspond roughly to
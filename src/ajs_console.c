@@ -42,6 +42,7 @@
 #include "ajs_services.h"
 #include "ajs_debugger.h"
 #include "ajs_storage.h"
+#include "ajs_heap.h"
 
 /**
  * Controls debug output for this module
@@ -91,6 +92,8 @@ static const char* const scriptConsoleIface[] = {
     "!evalResult output>ys",                       /* Result of a previous eval */
     "?lockdown status>y",                          /* Lock out the console application from interfacing with AJS */
     "!throw txt>s",                                /* Send a throw string to the controller */
+    "@heapStats>a(yqqqquu)",                       /* Per-pool heap statistics: heap, size, entries, in use, high-water, failed, borrowed */
+    "@loopStats>a{su}",                            /* Message loop counters by name */
     NULL
 };
 
@@ -157,6 +160,9 @@ static const AJ_Object consoleObjects[] = {
 #define LOCK_CONSOLE_MSGID  AJ_APP_MESSAGE_ID(0,  1, 10)
 #define THROW_SIGNAL_MSGID  AJ_APP_MESSAGE_ID(0,  1, 11)
 
+#define HEAP_STATS_PROP     AJ_APP_PROPERTY_ID(0, 1, 12)
+#define LOOP_STATS_PROP     AJ_APP_PROPERTY_ID(0, 1, 13)
+
 /**
  * Active session for this service
  */
@@ -264,7 +270,11 @@ void AJS_ThrowHandler(duk_context* ctx)
 {
     int nargs = duk_get_top(ctx);
 
-    if (consoleSession && !debugQuiet) {
+    /*
+     * The transmit buffer belongs to the stream message while a stream read function is running so
+     * output is printed locally instead of being sent to the console.
+     */
+    if (consoleSession && !debugQuiet && !AJS_IsStreaming()) {
         SignalConsole(ctx, THROW_SIGNAL_MSGID, nargs);
     } else {
         PrintArgs(ctx, "THROW: ");
@@ -275,7 +285,7 @@ void AJS_AlertHandler(duk_context* ctx, uint8_t alert)
 {
     int nargs = duk_get_top(ctx);
 
-    if (consoleSession && !debugQuiet) {
+    if (consoleSession && !debugQuiet && !AJS_IsStreaming()) {
         SignalConsole(ctx, alert ? ALERT_SIGNAL_MSGID : PRINT_SIGNAL_MSGID, nargs);
     } else {
         PrintArgs(ctx, alert ? "ALERT: " : "PRINT: ");
@@ -574,6 +584,121 @@ static AJ_Status Reset(AJ_Message* msg)
     return status;
 }
 
+static AJ_Status MarshalHeapStats(AJ_Message* msg)
+{
+    AJ_Status status;
+    AJ_Arg array;
+    uint8_t numPools = AJS_HeapNumPools();
+    uint8_t i;
+
+    status = AJ_MarshalContainer(msg, &array, AJ_ARG_ARRAY);
+    for (i = 0; (status == AJ_OK) && (i < numPools); ++i) {
+        AJS_HeapPoolStats stats;
+        AJ_Arg entry;
+        status = AJS_HeapGetPoolStats(i, &stats);
+        if (status == AJ_OK) {
+            status = AJ_MarshalContainer(msg, &entry, AJ_ARG_STRUCT);
+        }
+        if (status == AJ_OK) {
+            status = AJ_MarshalArgs(msg, "yqqqquu", stats.heapIndex, stats.size, stats.entries, stats.use, stats.hwm, stats.failed, stats.borrowed);
+        }
+        if (status == AJ_OK) {
+            status = AJ_MarshalCloseContainer(msg, &entry);
+        }
+    }
+    if (status == AJ_OK) {
+        status = AJ_MarshalCloseContainer(msg, &array);
+    }
+    return status;
+}
+
+static AJ_Status MarshalCounter(AJ_Message* msg, const char* name, uint32_t val)
+{
+    AJ_Status status;
+    AJ_Arg entry;
+
+    status = AJ_MarshalContainer(msg, &entry, AJ_ARG_DICT_ENTRY);
+    if (status == AJ_OK) {
+        status = AJ_MarshalArgs(msg, "su", name, val);
+    }
+    if (status == AJ_OK) {
+        status = AJ_MarshalCloseContainer(msg, &entry);
+    }
+    return status;
+}
+
+static AJ_Status MarshalLoopStats(AJ_Message* msg)
+{
+    AJ_Status status;
+    AJ_Arg array;
+    AJS_MsgLoopStats stats;
+    AJS_CallStats calls;
+    AJS_SessionStats sessions;
+
+    AJS_GetMsgLoopStats(&stats);
+    status = AJ_MarshalContainer(msg, &array, AJ_ARG_ARRAY);
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "batches", stats.batches);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "messages", stats.messages);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "maxBatch", stats.maxBatch);
+    }
+    AJS_GetCallStats(&calls);
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "callsOutstanding", calls.outstanding);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "callsCompleted", calls.completed);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "callsTimedOut", calls.timedOut);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "callsRejected", calls.rejected);
+    }
+    AJS_GetSessionStats(&sessions);
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "annoDropped", sessions.annoDropped);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "joinsStarted", sessions.joinsStarted);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "joinsRetried", sessions.joinsRetried);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "joinsFailed", sessions.joinsFailed);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "joinsTimedOut", sessions.joinsTimedOut);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "joinsQueued", sessions.joinsQueued);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "joinsInFlight", sessions.joinsInFlight);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "joinTimeAvg", sessions.joinTimeAvg);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "joinTimeMax", sessions.joinTimeMax);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "allJoinedTime", sessions.allJoinedTime);
+    }
+    if (status == AJ_OK) {
+        status = MarshalCounter(msg, "allocFailed", sessions.allocFailed);
+    }
+    if (status == AJ_OK) {
+        status = AJ_MarshalCloseContainer(msg, &array);
+    }
+    return status;
+}
+
 static AJ_Status PropGetHandler(AJ_Message* replyMsg, uint32_t propId, void* context)
 {
     switch (propId) {
@@ -586,6 +711,12 @@ static AJ_Status PropGetHandler(AJ_Message* replyMsg, uint32_t propId, void* con
     case MAX_SCRIPT_LEN_PROP:
         return AJ_MarshalArgs(replyMsg, "u", (uint32_t)AJS_MaxScriptLen());
 
+    case HEAP_STATS_PROP:
+        return MarshalHeapStats(replyMsg);
+
+    case LOOP_STATS_PROP:
+        return MarshalLoopStats(replyMsg);
+
     default:
         return AJ_ERR_UNEXPECTED;
     }
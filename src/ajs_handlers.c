@@ -52,6 +52,7 @@ static int NativeAdvertiseName(duk_context* ctx)
     const char* name = duk_require_string(ctx, 0);
     uint8_t op = AJ_BUS_START_ADVERTISING;
 
+    AJS_CheckNotStreaming(ctx, "advertiseName");
     if ((numArgs >= 2) && !duk_get_boolean(ctx, 1)) {
         op = AJ_BUS_STOP_ADVERTISING;
     } else {
@@ -77,6 +78,7 @@ static int NativeFindServiceByTransport(duk_context* ctx)
     uint8_t op;
     uint16_t transport = duk_require_int(ctx, 1);
 
+    AJS_CheckNotStreaming(ctx, "findServiceByTransport");
     AJ_InfoPrintf(("findServiceByName %s\n", name));
 
     if (duk_is_callable(ctx, 3)) {
@@ -137,6 +139,7 @@ static int NativeFindServiceByName(duk_context* ctx)
     const char* name = duk_require_string(ctx, 0);
     uint8_t op;
 
+    AJS_CheckNotStreaming(ctx, "findServiceByName");
     AJ_InfoPrintf(("findServiceByName %s\n", name));
 
     if (duk_is_callable(ctx, 2)) {
@@ -198,6 +201,7 @@ static int MatchRule(duk_context* ctx, int rule)
     const char* signal = duk_require_string(ctx, 1);
     int sessionless = duk_get_boolean(ctx, 2);
 
+    AJS_CheckNotStreaming(ctx, (rule == AJ_BUS_SIGNAL_ALLOW) ? "addMatch" : "removeMatch");
     if (sessionless) {
         duk_push_sprintf(ctx, "type='signal',sessionless='t',interface='%s',member='%s'", iface, signal);
     } else {
@@ -209,9 +213,10 @@ static int MatchRule(duk_context* ctx, int rule)
         duk_error(ctx, DUK_ERR_TYPE_ERROR, "MatchRule: %s", AJ_StatusText(status));
     }
     /*
-     * Push reply object. The method serial number is one less than the serial number
+     * The match rule reply is handled by the bus so push a reply object that is not waiting for it.
+     * The method serial number is one less than the serial number
      */
-    AJS_PushReplyObject(ctx, ajBus->serial - 1);
+    AJS_PushBareReplyObject(ctx, ajBus->serial - 1);
     return 1;
 }
 
@@ -231,6 +236,7 @@ static int NativeFindService(duk_context* ctx)
     const char* iface = duk_require_string(ctx, 0);
     uint8_t rule = AJ_BUS_SIGNAL_ALLOW;
 
+    AJS_CheckNotStreaming(ctx, "findService");
     if (duk_is_callable(ctx, 1)) {
         rule = AJ_BUS_SIGNAL_ALLOW;
     } else if (duk_is_undefined(ctx, 1)) {
@@ -242,24 +248,20 @@ static int NativeFindService(duk_context* ctx)
     status = AJ_BusSetSignalRule(ajBus, duk_get_string(ctx, -1), rule);
     if (rule == AJ_BUS_SIGNAL_ALLOW) {
         if (status == AJ_OK) {
-            AJS_GetGlobalStashObject(ctx, "serviceCB");
-            duk_dup(ctx, 1);
-            duk_put_prop_string(ctx, -2, iface);
-            duk_pop(ctx);
+            AJS_SetServiceCallback(ctx, iface, 1);
         }
     } else {
-        AJS_GetGlobalStashObject(ctx, "serviceCB");
-        duk_del_prop_string(ctx, -2, iface);
-        duk_pop(ctx);
+        AJS_SetServiceCallback(ctx, iface, 1);
     }
     /* ASACORE-2964 */
     if (status != AJ_OK) {
         duk_error(ctx, DUK_ERR_TYPE_ERROR, "findService: %s", AJ_StatusText(status));
     }
     /*
-     * Push reply object. The method serial number is one less than the serial number
+     * The match rule reply is handled by the bus so push a reply object that is not waiting for it.
+     * The method serial number is one less than the serial number
      */
-    AJS_PushReplyObject(ctx, ajBus->serial - 1);
+    AJS_PushBareReplyObject(ctx, ajBus->serial - 1);
     return 1;
 }
 
@@ -270,6 +272,7 @@ static int NativeFindSecureService(duk_context* ctx)
     const char* path = duk_require_string(ctx, 1);
     uint8_t rule = AJ_BUS_SIGNAL_ALLOW;
 
+    AJS_CheckNotStreaming(ctx, "findSecureService");
     if (duk_is_callable(ctx, 3)) {
         rule = AJ_BUS_SIGNAL_ALLOW;
     } else if (duk_is_undefined(ctx, 3)) {
@@ -289,24 +292,20 @@ static int NativeFindSecureService(duk_context* ctx)
     status = AJ_BusSetSignalRule(ajBus, duk_get_string(ctx, -1), rule);
     if (rule == AJ_BUS_SIGNAL_ALLOW) {
         if (status == AJ_OK) {
-            AJS_GetGlobalStashObject(ctx, "serviceCB");
-            duk_dup(ctx, 3);
-            duk_put_prop_string(ctx, -2, iface);
-            duk_pop(ctx);
+            AJS_SetServiceCallback(ctx, iface, 3);
         }
     } else {
-        AJS_GetGlobalStashObject(ctx, "serviceCB");
-        duk_del_prop_string(ctx, -1, iface);
-        duk_pop(ctx);
+        AJS_SetServiceCallback(ctx, iface, 3);
     }
     /* ASACORE-2964 */
     if (status != AJ_OK) {
         duk_error(ctx, DUK_ERR_TYPE_ERROR, "findService: %s", AJ_StatusText(status));
     }
     /*
-     * Push reply object. The method serial number is one less than the serial number
+     * The match rule reply is handled by the bus so push a reply object that is not waiting for it.
+     * The method serial number is one less than the serial number
      */
-    AJS_PushReplyObject(ctx, ajBus->serial - 1);
+    AJS_PushBareReplyObject(ctx, ajBus->serial - 1);
     return 1;
 }
 
@@ -533,6 +532,47 @@ static int NativeClearCredentials(duk_context* ctx)
     }
 }
 
+/*
+ * Register a handler for a specific interface method or signal. The handler is called instead of
+ * onMethodCall or onSignal. Passing null for the handler removes the registration.
+ */
+static int NativeOn(duk_context* ctx)
+{
+    const char* iface = duk_require_string(ctx, 0);
+    const char* member = duk_require_string(ctx, 1);
+
+    if (!duk_is_callable(ctx, 2) && !duk_is_null_or_undefined(ctx, 2)) {
+        duk_error(ctx, DUK_ERR_TYPE_ERROR, "Handler must be a function or null");
+    }
+    AJS_GetGlobalStashObject(ctx, "memberHandlers");
+    duk_get_prop_string(ctx, -1, iface);
+    if (!duk_is_object(ctx, -1)) {
+        duk_pop(ctx);
+        duk_push_object(ctx);
+        duk_dup_top(ctx);
+        duk_put_prop_string(ctx, -3, iface);
+    }
+    if (duk_is_callable(ctx, 2)) {
+        duk_dup(ctx, 2);
+        duk_put_prop_string(ctx, -2, member);
+    } else {
+        duk_del_prop_string(ctx, -1, member);
+    }
+    duk_pop_2(ctx);
+    AJS_MemberHandlersChanged();
+    return 0;
+}
+
+/*
+ * Tells AllJoyn.js that property values on an interface have changed. This discards any cached
+ * GetAll reply for the interface, or for all interfaces if no interface is specified.
+ */
+static int NativePropertyChanged(duk_context* ctx)
+{
+    AJS_InvalidatePropertyCache(ctx, duk_is_string(ctx, 0) ? duk_get_string(ctx, 0) : NULL, duk_is_string(ctx, 1) ? duk_get_string(ctx, 1) : NULL);
+    return 0;
+}
+
 static const duk_function_list_entry aj_native_functions[] = {
     { "getUniqueName",          NativeGetUniqueName,          0 },
     { "addMatch",               NativeAddMatch,               3 },
@@ -547,6 +587,8 @@ static const duk_function_list_entry aj_native_functions[] = {
     { "factoryReset",           NativeFactoryReset,           0 },
     { "offboard",               NativeOffboard,               0 },
     { "clearCredentials",       NativeClearCredentials,       1 },
+    { "on",                     NativeOn,                     3 },
+    { "propertyChanged",        NativePropertyChanged,        2 },
     { NULL }
 };
 
@@ -60,9 +60,14 @@ typedef struct {
     void* startOfPool; /* Address of end of this pool */
     void* endOfPool;   /* Address of end of this pool */
     void* freeList;    /* Free list for this pool */
-#ifndef NDEBUG
+    uint8_t nextPool;  /* Index of the next pool in the same heap */
+    uint8_t borrowTo;  /* Index of the pool that will satisfy an allocation that lands on this pool */
+    uint8_t isLow;     /* Pool is below its low-watermark */
     uint16_t use;      /* Number of entries in use */
     uint16_t hwm;      /* High-water mark */
+    uint32_t failed;   /* Allocations that landed on this pool and could not be satisfied */
+    uint32_t borrowed; /* Allocations that landed on this pool and were satisfied by a larger pool */
+#ifndef NDEBUG
     uint16_t min;      /* Min allocation from this pool */
     uint16_t max;      /* Max allocation from this pool */
 #endif
@@ -75,33 +80,150 @@ typedef struct _MemBlock {
 
 #define MAX_HEAPS  4
 
+/*
+ * Pointer compression is enabled by the Duktape configuration
+ */
+#if defined(DUK_OPT_HEAPPTR16) || defined(DUK_USE_HEAPPTR16)
+#define HEAPPTR16
+#endif
+
+/*
+ * Largest scaling applied to the heap offsets of compressed pointers
+ */
+#define MAX_PTR_SHIFT  7
+
+/*
+ * Bounds on the size of the segments used to map a heap address to the pool that owns it. The
+ * segment size is chosen so that no pool is smaller than a segment so a segment will normally
+ * straddle at most two pools. The segment size is increased if needed to keep the map small.
+ */
+#define MIN_SEGMENT_SHIFT  4
+#define MAX_SEGMENTS       1024
+
+typedef struct {
+    uint8_t* start;   /* Start of the pool memory in this heap */
+    uint8_t* end;     /* End of the pool memory in this heap */
+    uint8_t* segMap;  /* Maps segment offset to the pool that owns the first byte of the segment */
+    uint8_t* base;    /* Base address for compressed pointers into this heap */
+    uint8_t ptrShift; /* Scaling applied to the offset of a compressed pointer into this heap */
+} HeapSegments;
+
 typedef struct {
     uint8_t numPools;
+    uint8_t numHeaps;
+    uint8_t segShift;
+    uint8_t lowMemory;    /* A pool has crossed its low-watermark */
+    uint8_t ptrBits;      /* Number of bits in a compressed pointer that hold the heap offset */
+    uint16_t maxSize;     /* Largest allocation that can be satisfied */
     const AJS_HeapConfig* config;
     Pool* pools;
+    uint8_t* sizeMap;     /* Maps allocation size quantized by AJS_HEAP_POOL_ROUNDING to the best-fit pool */
+    HeapSegments heaps[MAX_HEAPS];
 } HeapInfo;
 
 static HeapInfo heapInfo;
 
+/*
+ * Size of a pool entry after rounding
+ */
+static size_t EntrySize(const AJS_HeapConfig* config)
+{
+    size_t sz = config->size;
+    return sz + AJS_HEAP_POOL_ROUNDING - (sz & (AJS_HEAP_POOL_ROUNDING - 1));
+}
+
+/*
+ * Memory required for the pools in a specific heap not including the heap tables
+ */
+static size_t PoolMemRequired(const AJS_HeapConfig* heapConfig, uint8_t numPools, uint8_t heapNum)
+{
+    size_t poolSz = 0;
+    uint8_t i;
+
+    for (i = 0; i < numPools; ++i) {
+        if (heapConfig[i].heapIndex == heapNum) {
+            poolSz += EntrySize(&heapConfig[i]) * heapConfig[i].entries;
+        }
+    }
+    return poolSz;
+}
+
+/*
+ * The segment size is the largest power of two that is not bigger than the smallest pool
+ */
+static uint8_t SegmentShift(const AJS_HeapConfig* heapConfig, uint8_t numPools)
+{
+    size_t minPool = 0;
+    size_t maxHeap = 0;
+    uint8_t shift = MIN_SEGMENT_SHIFT;
+    uint8_t i;
+
+    for (i = 0; i < numPools; ++i) {
+        size_t poolSz = EntrySize(&heapConfig[i]) * heapConfig[i].entries;
+        if (poolSz && (!minPool || (poolSz < minPool))) {
+            minPool = poolSz;
+        }
+    }
+    for (i = 0; i < MAX_HEAPS; ++i) {
+        maxHeap = max(maxHeap, PoolMemRequired(heapConfig, numPools, i));
+    }
+    while (((size_t)2 << shift) <= minPool) {
+        ++shift;
+    }
+    while ((maxHeap >> shift) >= MAX_SEGMENTS) {
+        ++shift;
+    }
+    return shift;
+}
+
+static size_t SegmentCount(const AJS_HeapConfig* heapConfig, uint8_t numPools, uint8_t heapNum, uint8_t shift)
+{
+    return (PoolMemRequired(heapConfig, numPools, heapNum) + ((size_t)1 << shift) - 1) >> shift;
+}
+
+static uint16_t MaxPoolSize(const AJS_HeapConfig* heapConfig, uint8_t numPools)
+{
+    uint16_t maxSize = 0;
+    uint8_t i;
+
+    for (i = 0; i < numPools; ++i) {
+        maxSize = max(maxSize, heapConfig[i].size);
+    }
+    return maxSize;
+}
+
+#define SIZE_CLASS(sz)  (((sz) + AJS_HEAP_POOL_ROUNDING - 1) / AJS_HEAP_POOL_ROUNDING)
+
+/*
+ * Size of the heap tables, these are allocated from heap 0
+ */
+static size_t TablesRequired(const AJS_HeapConfig* heapConfig, uint8_t numPools)
+{
+    size_t tableSz = sizeof(Pool) * numPools;
+    uint8_t shift = SegmentShift(heapConfig, numPools);
+    uint8_t i;
+
+    for (i = 0; i < MAX_HEAPS; ++i) {
+        tableSz += SegmentCount(heapConfig, numPools, i, shift);
+    }
+    tableSz += SIZE_CLASS(MaxPoolSize(heapConfig, numPools)) + 1;
+    /*
+     * Keep the pools aligned
+     */
+    return (tableSz + AJS_HEAP_POOL_ROUNDING - 1) & ~(AJS_HEAP_POOL_ROUNDING - 1);
+}
+
 size_t AJS_HeapRequired(const AJS_HeapConfig* heapConfig, uint8_t numPools, uint8_t heapNum)
 {
     size_t heapSz = 0;
-    uint8_t i;
 
     /*
-     * Pool table is allocated from heap 0
+     * Pool table and segment maps are allocated from heap 0
      */
     if (heapNum == 0) {
-        heapSz += sizeof(Pool) * numPools;
-    }
-    for (i = 0; i < numPools; ++i) {
-        if (heapConfig[i].heapIndex == heapNum) {
-            size_t sz = heapConfig[i].size;
-            sz += AJS_HEAP_POOL_ROUNDING - (sz & (AJS_HEAP_POOL_ROUNDING - 1));
-            heapSz += sz * heapConfig[i].entries;
-        }
+        heapSz += TablesRequired(heapConfig, numPools);
     }
-    return heapSz;
+    return heapSz + PoolMemRequired(heapConfig, numPools, heapNum);
 }
 
 void AJS_HeapTerminate(void* heap)
@@ -109,58 +231,136 @@ void AJS_HeapTerminate(void* heap)
     heapInfo.pools = NULL;
 }
 
+/*
+ * Called when a pool becomes empty or non-empty to update the pool that will satisfy allocations
+ * for this pool and for any smaller pools that borrow from it.
+ */
+static void UpdateBorrowTo(uint8_t i)
+{
+    while (TRUE) {
+        Pool* p = &heapInfo.pools[i];
+        if (p->freeList) {
+            p->borrowTo = i;
+        } else if (heapInfo.config[i].borrow && ((i + 1) < heapInfo.numPools)) {
+            p->borrowTo = p[1].borrowTo;
+        } else {
+            p->borrowTo = heapInfo.numPools;
+        }
+        if ((i == 0) || !heapInfo.config[i - 1].borrow) {
+            break;
+        }
+        --i;
+    }
+}
+
+#ifdef HEAPPTR16
+/*
+ * A compressed pointer holds a heap index in the high bits and a scaled offset from the base of
+ * that heap in the low bits. The scaling for each heap is the smallest that lets the offset span
+ * the heap, this requires that all pool entries in the heap are aligned to the scaled offset.
+ */
+static AJ_Status InitPtr16(void)
+{
+    uint8_t h;
+
+    heapInfo.ptrBits = 16;
+    if (heapInfo.numHeaps > 1) {
+        heapInfo.ptrBits -= (heapInfo.numHeaps > 2) ? 2 : 1;
+    }
+    for (h = 0; h < heapInfo.numHeaps; ++h) {
+        HeapSegments* heap = &heapInfo.heaps[h];
+        size_t span = heap->end - heap->base;
+        uint8_t shift = 0;
+        uint8_t i;
+
+        while (span && (((span - 1) >> shift) >> heapInfo.ptrBits)) {
+            if (++shift > MAX_PTR_SHIFT) {
+                AJ_ErrPrintf(("Heap %d is too large for pointer compression\n", h));
+                return AJ_ERR_RESOURCES;
+            }
+        }
+        for (i = 0; i < heapInfo.numPools; ++i) {
+            const Pool* p = &heapInfo.pools[i];
+            size_t mask = ((size_t)1 << shift) - 1;
+            if ((heapInfo.config[i].heapIndex != h) || (p->startOfPool == p->endOfPool)) {
+                continue;
+            }
+            if ((((uint8_t*)p->startOfPool - heap->base) & mask) || (EntrySize(&heapInfo.config[i]) & mask)) {
+                AJ_ErrPrintf(("Pointer compression for heap %d requires AJS_HEAP_POOL_ROUNDING %d\n", h, 1 << shift));
+                return AJ_ERR_RESOURCES;
+            }
+        }
+        heap->ptrShift = shift;
+        AJ_InfoPrintf(("Heap %d compressed pointer shift %d\n", h, shift));
+    }
+    return AJ_OK;
+}
+#endif
+
 AJ_Status AJS_HeapInit(void** heap, size_t* heapSz, const AJS_HeapConfig* heapConfig, uint8_t numPools, uint8_t numHeaps)
 {
     uint8_t i;
+    size_t sc;
     uint8_t* heapEnd[MAX_HEAPS];
     uint8_t* heapStart[MAX_HEAPS];
+    uint8_t* segMap;
+    uint8_t lastPool[MAX_HEAPS];
 
     if (numHeaps > MAX_HEAPS) {
         return AJ_ERR_RESOURCES;
     }
-    /*
-     * Pointer compresson is only supported when there is a single heap smaller than 256K
-     */
-#ifdef DUK_OPT_HEAPPTR_ENC16
-    if (numHeaps > 1) {
-        AJ_ErrPrintf(("Pointer compression not allowed with multiple heaps\n"));
-        return AJ_ERR_RESOURCES;
-    }
-    if (*heapSz >= (256 * 1024)) {
-        AJ_ErrPrintf(("Pointer compression not allowed for heaps >= 256K\n"));
+    if (heapSz[0] < TablesRequired(heapConfig, numPools)) {
+        AJ_ErrPrintf(("Heap 0 is too small for the heap tables\n"));
         return AJ_ERR_RESOURCES;
     }
-#endif
     /*
-     * Pre-allocate the pool table from the first heap
+     * Pre-allocate the pool table, segment maps, and size map from the first heap
      */
     heapInfo.pools = (Pool*)heap[0];
-    heapEnd[0] = heapStart[0] = (uint8_t*)(&heapInfo.pools[numPools]);
     heapInfo.config = heapConfig;
     heapInfo.numPools = numPools;
+    heapInfo.numHeaps = numHeaps;
+    heapInfo.lowMemory = FALSE;
+    heapInfo.segShift = SegmentShift(heapConfig, numPools);
+    heapStart[0] = (uint8_t*)heap[0] + TablesRequired(heapConfig, numPools);
+    segMap = (uint8_t*)(&heapInfo.pools[numPools]);
     /*
      * Get bounds for other heaps
      */
     for (i = 1; i < numHeaps; ++i) {
-        heapEnd[i] = heapStart[i] = heap[i];
+        heapStart[i] = heap[i];
     }
+    for (i = 0; i < numHeaps; ++i) {
+        size_t numSegs = SegmentCount(heapConfig, numPools, i, heapInfo.segShift);
+        heapEnd[i] = heapStart[i];
+        heapInfo.heaps[i].start = heapStart[i];
+        heapInfo.heaps[i].segMap = segMap;
+        memset(segMap, 0, numSegs);
+        segMap += numSegs;
+        lastPool[i] = numPools;
+    }
+    heapInfo.maxSize = MaxPoolSize(heapConfig, numPools);
+    heapInfo.sizeMap = segMap;
     /*
      * Initialize the pool table
      */
     memset(heapInfo.pools, 0, numPools * sizeof(Pool));
     for (i = 0; i < numPools; ++i) {
         uint16_t n;
+        size_t seg;
         Pool* p = &heapInfo.pools[i];
         uint8_t heapIndex = heapConfig[i].heapIndex;
-        size_t sz = heapConfig[i].size;
-        /*
-         * Round up the pool entry size
-         */
-        sz += AJS_HEAP_POOL_ROUNDING - (sz & (AJS_HEAP_POOL_ROUNDING - 1));
+        size_t sz = EntrySize(&heapConfig[i]);
+
+        if (heapIndex >= numHeaps) {
+            AJ_ErrPrintf(("Pool %d is assigned to heap %d which does not exist\n", i, heapIndex));
+            return AJ_ERR_RESOURCES;
+        }
         /*
          * Initialize the free list for this pool
          */
         p->startOfPool = (void*)heapEnd[heapIndex];
+        p->nextPool = numPools;
         for (n = heapConfig[i].entries; n != 0; --n) {
             MemBlock* block = (MemBlock*)heapEnd[heapIndex];
             block->next = p->freeList;
@@ -169,20 +369,81 @@ AJ_Status AJS_HeapInit(void** heap, size_t* heapSz, const AJS_HeapConfig* heapCo
             /*
              * Check there is room for this entry
              */
-            if ((heapEnd[heapIndex] - heapStart[heapIndex]) > heapSz[heapIndex]) {
+            if ((heapEnd[heapIndex] - (uint8_t*)heap[heapIndex]) > heapSz[heapIndex]) {
                 AJ_ErrPrintf(("Heap %d is too small for the requested pool allocations\n", heapIndex));
                 return AJ_ERR_RESOURCES;
             }
         }
         p->endOfPool = (void*)heapEnd[heapIndex];
 #ifndef NDEBUG
-        p->use = 0;
-        p->hwm = 0;
         p->max = 0;
         p->min = 0xFFFF;
 #endif
+        if (p->endOfPool == p->startOfPool) {
+            continue;
+        }
+        /*
+         * Chain the pools in each heap together and record this pool in the segment map for each
+         * segment that starts inside this pool.
+         */
+        if (lastPool[heapIndex] != numPools) {
+            heapInfo.pools[lastPool[heapIndex]].nextPool = i;
+        }
+        lastPool[heapIndex] = i;
+        seg = ((uint8_t*)p->startOfPool - heapStart[heapIndex] + ((size_t)1 << heapInfo.segShift) - 1) >> heapInfo.segShift;
+        while ((heapStart[heapIndex] + (seg << heapInfo.segShift)) < (uint8_t*)p->endOfPool) {
+            heapInfo.heaps[heapIndex].segMap[seg++] = i;
+        }
     }
+    for (i = 0; i < numHeaps; ++i) {
+        heapInfo.heaps[i].end = heapEnd[i];
+    }
+    /*
+     * Each size class maps to the first pool that can hold the smallest size in that class
+     */
+    for (sc = 0, i = 0; sc <= SIZE_CLASS(heapInfo.maxSize); ++sc) {
+        size_t minSz = sc ? (sc - 1) * AJS_HEAP_POOL_ROUNDING + 1 : 0;
+        while ((i < numPools) && (heapConfig[i].size < minSz)) {
+            ++i;
+        }
+        heapInfo.sizeMap[sc] = i;
+    }
+    for (i = numPools; i != 0; --i) {
+        UpdateBorrowTo(i - 1);
+    }
+    for (i = 0; i < numHeaps; ++i) {
+        heapInfo.heaps[i].base = (uint8_t*)heap[i];
+    }
+#ifdef HEAPPTR16
+    return InitPtr16();
+#else
     return AJ_OK;
+#endif
+}
+
+/*
+ * Locate the pool from which a block was allocated. The segment map gives the pool that owns the
+ * start of the segment, the block is either in that pool or in the pool that follows it.
+ */
+static Pool* FindPool(const void* mem, uint8_t* index)
+{
+    const uint8_t* addr = (const uint8_t*)mem;
+    uint8_t h;
+
+    for (h = 0; h < heapInfo.numHeaps; ++h) {
+        const HeapSegments* heap = &heapInfo.heaps[h];
+        if ((addr >= heap->start) && (addr < heap->end)) {
+            uint8_t i = heap->segMap[(addr - heap->start) >> heapInfo.segShift];
+            Pool* p = &heapInfo.pools[i];
+            while (addr >= (uint8_t*)p->endOfPool) {
+                i = p->nextPool;
+                p = &heapInfo.pools[i];
+            }
+            *index = i;
+            return p;
+        }
+    }
+    return NULL;
 }
 
 uint8_t AJS_HeapIsInitialized()
@@ -190,7 +451,7 @@ uint8_t AJS_HeapIsInitialized()
     return heapInfo.pools != NULL;
 }
 
-void* AJS_Alloc(void* userData, size_t sz)
+static void* PoolAlloc(size_t sz)
 {
     Pool* p = heapInfo.pools;
     uint8_t i;
@@ -199,42 +460,77 @@ void* AJS_Alloc(void* userData, size_t sz)
         AJ_ErrPrintf(("Heap not initialized\n"));
         return NULL;
     }
-    /*
-     * Find pool that can satisfy the allocation
-     */
-    for (i = 0; i < heapInfo.numPools; ++i, ++p) {
-        if (sz <= heapInfo.config[i].size) {
-            MemBlock* block = (MemBlock*)p->freeList;
-            if (!block) {
-                /*
-                 * Are we allowed to borrow from next pool?
-                 */
-                if (heapInfo.config[i].borrow) {
-                    continue;
-                }
-                break;
-            }
+    if (sz <= heapInfo.maxSize) {
+        uint8_t best;
+        /*
+         * Find the best-fit pool, the size class gives the first pool that can hold the smallest size
+         * in the class so skip forward over any pools in the same class that are too small.
+         */
+        best = heapInfo.sizeMap[SIZE_CLASS(sz)];
+        while (sz > heapInfo.config[best].size) {
+            ++best;
+        }
+        /*
+         * Pick up the pool that will satisfy the allocation which may be a larger pool if the
+         * best-fit pool is exhausted and is allowed to borrow.
+         */
+        i = heapInfo.pools[best].borrowTo;
+        if (i < heapInfo.numPools) {
+            MemBlock* block;
+            p = &heapInfo.pools[i];
+            block = (MemBlock*)p->freeList;
             AJ_InfoPrintf(("AJS_Alloc pool[%d] allocated %d\n", heapInfo.config[i].size, (int)sz));
             p->freeList = block->next;
-#ifndef NDEBUG
+            if (!p->freeList) {
+                UpdateBorrowTo(i);
+            }
+            if (i != best) {
+                ++heapInfo.pools[best].borrowed;
+            }
             ++p->use;
             p->hwm = max(p->use, p->hwm);
+            if (!p->isLow && ((heapInfo.config[i].entries - p->use) < heapInfo.config[i].lowWater)) {
+                p->isLow = TRUE;
+                heapInfo.lowMemory = TRUE;
+            }
+#ifndef NDEBUG
             p->max = max(p->max, sz);
             p->min = min(p->min, sz);
 #endif
             return (void*)block;
         }
+        ++heapInfo.pools[best].failed;
+    } else if (heapInfo.numPools) {
+        /*
+         * Allocations that are too big for any pool are charged to the largest pool
+         */
+        ++heapInfo.pools[heapInfo.numPools - 1].failed;
     }
     AJ_ErrPrintf(("AJS_Alloc of %d bytes failed\n", (int)sz));
     AJS_HeapDump();
     return NULL;
 }
 
+void* AJS_Alloc(void* userData, size_t sz)
+{
+    void* mem = PoolAlloc(sz);
+    AJS_HeapTrace(AJS_HEAP_TRACE_ALLOC, mem, NULL, sz);
+    return mem;
+}
+
 duk_uint16_t AJS_EncodePtr16(void* userData, const void* ptr)
 {
     if (ptr) {
-        ptrdiff_t offset = (ptrdiff_t)ptr - (ptrdiff_t)heapInfo.pools;
-        return (duk_uint16_t)(offset >> 2);
+        const uint8_t* addr = (const uint8_t*)ptr;
+        const HeapSegments* heap = heapInfo.heaps;
+        const HeapSegments* last = &heapInfo.heaps[heapInfo.numHeaps - 1];
+        /*
+         * The last heap doesn't need to be checked so there is no search with a single heap
+         */
+        while ((heap != last) && ((addr < heap->base) || (addr >= heap->end))) {
+            ++heap;
+        }
+        return (duk_uint16_t)(((uint32_t)(heap - heapInfo.heaps) << heapInfo.ptrBits) | ((size_t)(addr - heap->base) >> heap->ptrShift));
     } else {
         return 0;
     }
@@ -243,8 +539,9 @@ duk_uint16_t AJS_EncodePtr16(void* userData, const void* ptr)
 void* AJS_DecodePtr16(void* userData, duk_uint16_t enc)
 {
     if (enc) {
-        ptrdiff_t offset = ((ptrdiff_t)enc) << 2;
-        return (void*)(offset + (ptrdiff_t)heapInfo.pools);
+        const HeapSegments* heap = &heapInfo.heaps[(uint32_t)enc >> heapInfo.ptrBits];
+        size_t offset = (size_t)(enc & ((1u << heapInfo.ptrBits) - 1)) << heap->ptrShift;
+        return (void*)(heap->base + offset);
     } else {
         return NULL;
     }
@@ -253,22 +550,23 @@ void* AJS_DecodePtr16(void* userData, duk_uint16_t enc)
 void AJS_Free(void* userData, void* mem)
 {
     if (mem) {
-        Pool* p = heapInfo.pools;
         uint8_t i;
-        /*
-         * Locate the pool from which the released memory was allocated
-         */
-        for (i = 0; i < heapInfo.numPools; ++i, ++p) {
-            if (((ptrdiff_t)mem >= (ptrdiff_t)p->startOfPool) && ((ptrdiff_t)mem < (ptrdiff_t)p->endOfPool)) {
-                MemBlock* block = (MemBlock*)mem;
-                block->next = p->freeList;
-                p->freeList = block;
-                AJ_InfoPrintf(("AJS_Free pool[%d]\n", heapInfo.config[i].size));
-#ifndef NDEBUG
-                --p->use;
-#endif
-                return;
+        Pool* p = FindPool(mem, &i);
+
+        AJS_HeapTrace(AJS_HEAP_TRACE_FREE, mem, NULL, 0);
+        if (p) {
+            MemBlock* block = (MemBlock*)mem;
+            block->next = p->freeList;
+            p->freeList = block;
+            if (!block->next) {
+                UpdateBorrowTo(i);
+            }
+            AJ_InfoPrintf(("AJS_Free pool[%d]\n", heapInfo.config[i].size));
+            --p->use;
+            if (p->isLow && ((heapInfo.config[i].entries - p->use) >= heapInfo.config[i].lowWater)) {
+                p->isLow = FALSE;
             }
+            return;
         }
         AJ_ErrPrintf(("AJS_Free invalid heap pointer %0x\n", (size_t)mem));
         AJ_ASSERT(0);
@@ -277,42 +575,43 @@ void AJS_Free(void* userData, void* mem)
 
 void* AJS_Realloc(void* userData, void* mem, size_t newSz)
 {
-    Pool* p = heapInfo.pools;
-    uint8_t i;
-
     if (mem) {
-        /*
-         * Locate the pool from which the released memory was allocated
-         */
-        for (i = 0; i < heapInfo.numPools; ++i, ++p) {
-            if (((ptrdiff_t)mem >= (ptrdiff_t)p->startOfPool) && ((ptrdiff_t)mem < (ptrdiff_t)p->endOfPool)) {
-                size_t oldSz = heapInfo.config[i].size;
-                /*
-                 * Don't need to do anything if the same block would be reused
-                 */
-                if ((newSz <= oldSz) && ((i == 0) || (newSz > heapInfo.config[i - 1].size))) {
-                    AJ_InfoPrintf(("AJS_Realloc pool[%d] %d bytes in place\n", (int)oldSz, (int)newSz));
-#ifndef NDEBUG
-                    p->max = max(p->max, newSz);
-#endif
-                } else {
-                    MemBlock* block = (MemBlock*)mem;
-                    AJ_InfoPrintf(("AJS_Realloc pool[%d] by AJS_Alloc(%d)\n", (int)oldSz, (int)newSz));
-                    mem = AJS_Alloc(userData, newSz);
-                    if (mem) {
-                        memcpy(mem, (void*)block, min(oldSz, newSz));
-                        /*
-                         * Put old block on the free list
-                         */
-                        block->next = p->freeList;
-                        p->freeList = block;
+        uint8_t i;
+        Pool* p = FindPool(mem, &i);
+
+        if (p) {
+            size_t oldSz = heapInfo.config[i].size;
+            /*
+             * Don't need to do anything if the same block would be reused
+             */
+            if ((newSz <= oldSz) && ((i == 0) || (newSz > heapInfo.config[i - 1].size))) {
+                AJ_InfoPrintf(("AJS_Realloc pool[%d] %d bytes in place\n", (int)oldSz, (int)newSz));
 #ifndef NDEBUG
-                        --p->use;
+                p->max = max(p->max, newSz);
 #endif
+                AJS_HeapTrace(AJS_HEAP_TRACE_REALLOC, mem, mem, newSz);
+            } else {
+                MemBlock* block = (MemBlock*)mem;
+                AJ_InfoPrintf(("AJS_Realloc pool[%d] by AJS_Alloc(%d)\n", (int)oldSz, (int)newSz));
+                mem = PoolAlloc(newSz);
+                if (mem) {
+                    memcpy(mem, (void*)block, min(oldSz, newSz));
+                    /*
+                     * Put old block on the free list
+                     */
+                    block->next = p->freeList;
+                    p->freeList = block;
+                    if (!block->next) {
+                        UpdateBorrowTo(i);
+                    }
+                    --p->use;
+                    if (p->isLow && ((heapInfo.config[i].entries - p->use) >= heapInfo.config[i].lowWater)) {
+                        p->isLow = FALSE;
                     }
                 }
-                return mem;
+                AJS_HeapTrace(AJS_HEAP_TRACE_REALLOC, mem, block, newSz);
             }
+            return mem;
         }
         AJ_ErrPrintf(("AJS_Realloc invalid heap pointer %0x\n", (size_t)mem));
         AJ_ASSERT(0);
@@ -324,6 +623,41 @@ void* AJS_Realloc(void* userData, void* mem, size_t newSz)
     return NULL;
 }
 
+uint8_t AJS_HeapLowMemory(void)
+{
+    uint8_t lowMemory = heapInfo.lowMemory;
+    heapInfo.lowMemory = FALSE;
+    return lowMemory;
+}
+
+uint8_t AJS_HeapNumPools(void)
+{
+    return heapInfo.pools ? heapInfo.numPools : 0;
+}
+
+size_t AJS_HeapPoolOverhead(void)
+{
+    return sizeof(Pool);
+}
+
+AJ_Status AJS_HeapGetPoolStats(uint8_t pool, AJS_HeapPoolStats* stats)
+{
+    const Pool* p;
+
+    if (!heapInfo.pools || (pool >= heapInfo.numPools)) {
+        return AJ_ERR_INVALID;
+    }
+    p = &heapInfo.pools[pool];
+    stats->heapIndex = heapInfo.config[pool].heapIndex;
+    stats->size = heapInfo.config[pool].size;
+    stats->entries = heapInfo.config[pool].entries;
+    stats->use = p->use;
+    stats->hwm = p->hwm;
+    stats->failed = p->failed;
+    stats->borrowed = p->borrowed;
+    return AJ_OK;
+}
+
 #ifndef NDEBUG
 void AJS_HeapDump(void)
 {
@@ -339,8 +673,8 @@ void AJS_HeapDump(void)
             if (p->hwm == 0) {
                 AJ_AlwaysPrintf(("heap[%d] pool[%d] unused\n", heapInfo.config[i].heapIndex, heapInfo.config[i].size));
             } else {
-                AJ_AlwaysPrintf(("heap[%d] pool[%d] used=%d free=%d high-water=%d min-alloc=%d max-alloc=%d\n",
-                                 heapInfo.config[i].heapIndex, heapInfo.config[i].size, p->use, heapInfo.config[i].entries - p->use, p->hwm, p->min, p->max));
+                AJ_AlwaysPrintf(("heap[%d] pool[%d] used=%d free=%d high-water=%d min-alloc=%d max-alloc=%d failed=%u borrowed=%u\n",
+                                 heapInfo.config[i].heapIndex, heapInfo.config[i].size, p->use, heapInfo.config[i].entries - p->use, p->hwm, p->min, p->max, p->failed, p->borrowed));
             }
             memUse += p->use * heapInfo.config[i].size;
             memHigh += p->hwm * heapInfo.config[i].size;
@@ -351,4 +685,26 @@ void AJS_HeapDump(void)
 }
 #endif
 
+#else
+
+uint8_t AJS_HeapLowMemory(void)
+{
+    return FALSE;
+}
+
+uint8_t AJS_HeapNumPools(void)
+{
+    return 0;
+}
+
+size_t AJS_HeapPoolOverhead(void)
+{
+    return 0;
+}
+
+AJ_Status AJS_HeapGetPoolStats(uint8_t pool, AJS_HeapPoolStats* stats)
+{
+    return AJ_ERR_INVALID;
+}
+
 #endif // AJS_USE_NATIVE_MALLOC
\ No newline at end of file
@@ -49,12 +49,16 @@ typedef struct _AJS_HeapConfig {
     const uint16_t entries;  /* Number of entries in this pool */
     const uint8_t borrow;    /* Indicates if pool can borrow from then next larger pool */
     const uint8_t heapIndex; /* What heap memory location to use for this pool */
+    const uint16_t lowWater; /* Number of free entries below which the pool is low on memory, 0 to disable */
 } AJS_HeapConfig;
 
 /*
- * This should be 4 or 8
+ * This should be 4 or 8. With 16 bit pointer compression a heap larger than 256K (128K with two
+ * heaps and 64K with three or four heaps) requires 8 byte rounding.
  */
+#ifndef AJS_HEAP_POOL_ROUNDING
 #define AJS_HEAP_POOL_ROUNDING  4
+#endif
 
 /**
  * Example of a heap pool description. Note that the pool sizes must be in ascending order of size
@@ -64,7 +68,7 @@ typedef struct _AJS_HeapConfig {
 
    static const AJS_HeapConfig memPools[] = {
     { 32,   1, AJS_POOL_BORROW },
-    { 96,   4, },
+    { 96,   4, 0, 0, 1 },
     { 192,  1, }
    };
 
@@ -146,6 +150,76 @@ void AJS_Free(void* userData, void* mem);
  */
 void* AJS_Realloc(void* userData, void* mem, size_t newSz);
 
+/**
+ * Indicates if any pool has dropped below its low-watermark since this function was last called.
+ * A pool is reported once each time it crosses its low-watermark.
+ *
+ * @return  TRUE if a pool crossed its low-watermark.
+ */
+uint8_t AJS_HeapLowMemory(void);
+
+/**
+ * Per-pool allocation statistics. These are maintained in release builds.
+ */
+typedef struct _AJS_HeapPoolStats {
+    uint8_t heapIndex; /* Heap memory location used for this pool */
+    uint16_t size;     /* Size of the pool entries in bytes */
+    uint16_t entries;  /* Number of entries in this pool */
+    uint16_t use;      /* Number of entries currently in use */
+    uint16_t hwm;      /* High-water mark for entries in use */
+    uint32_t failed;   /* Number of allocations for which this was the best-fit pool that failed */
+    uint32_t borrowed; /* Number of allocations for which this was the best-fit pool that borrowed from a larger pool */
+} AJS_HeapPoolStats;
+
+/**
+ * Get the number of pools in the heap
+ *
+ * @return  The number of pools or zero if the heap is not initialized.
+ */
+uint8_t AJS_HeapNumPools(void);
+
+/**
+ * Get the size of the per-pool bookkeeping allocated from the heap tables
+ *
+ * @return  The size of the pool descriptor, zero if the pool allocator is not being used.
+ */
+size_t AJS_HeapPoolOverhead(void);
+
+/**
+ * Get the allocation statistics for a heap pool
+ *
+ * @param pool   Index of the pool, pools are indexed in the order they appear in the heap config
+ * @param stats  Returns the statistics for the pool
+ *
+ * @return - AJ_OK if the statistics were returned
+ *         - AJ_ERR_INVALID if the pool index is not valid
+ */
+AJ_Status AJS_HeapGetPoolStats(uint8_t pool, AJS_HeapPoolStats* stats);
+
+/*
+ * Record types for the heap allocation trace
+ */
+#define AJS_HEAP_TRACE_ALLOC    'A'
+#define AJS_HEAP_TRACE_FREE     'F'
+#define AJS_HEAP_TRACE_REALLOC  'R'
+
+#ifdef AJS_HEAP_TRACE
+/**
+ * Record an allocation event in the heap trace. The trace is a binary log that can be replayed by
+ * tools/heaptune.py to compute a heap configuration. The trace header records the pool rounding and
+ * the pool descriptor size of the build so the tuner models the heap tables correctly. Tracing is
+ * only supported on some targets.
+ *
+ * @param op      The record type AJS_HEAP_TRACE_ALLOC, AJS_HEAP_TRACE_FREE, or AJS_HEAP_TRACE_REALLOC
+ * @param mem     The allocated or freed block, NULL if an allocation failed
+ * @param oldMem  For a reallocation the block that was reallocated
+ * @param sz      The requested size for an allocation or reallocation
+ */
+void AJS_HeapTrace(uint8_t op, const void* mem, const void* oldMem, size_t sz);
+#else
+#define AJS_HeapTrace(op, mem, oldMem, sz) do { } while (0)
+#endif
+
 #ifndef NDEBUG
 void AJS_HeapDump(void);
 #else
@@ -56,6 +56,93 @@ static AJ_Status MarshalJSBuffer(duk_context* ctx, AJ_Message* msg, uint8_t type
     return status;
 }
 
+static size_t ScalarSize(uint8_t typeId)
+{
+    switch (typeId) {
+    case AJ_ARG_BYTE:
+        return sizeof(uint8_t);
+
+    case AJ_ARG_INT16:
+    case AJ_ARG_UINT16:
+        return sizeof(uint16_t);
+
+    case AJ_ARG_BOOLEAN:
+    case AJ_ARG_INT32:
+    case AJ_ARG_UINT32:
+        return sizeof(uint32_t);
+
+    default:
+        return sizeof(uint64_t);
+    }
+}
+
+/*
+ * Marshal a JavaScript array of numbers as an array of scalars. The elements are converted into a
+ * native buffer in a single pass and the buffer is marshalled in one call so the per-element cost
+ * is just the number conversion.
+ */
+static AJ_Status MarshalScalarArray(duk_context* ctx, AJ_Message* msg, uint8_t typeId, duk_idx_t idx)
+{
+    AJ_Status status;
+    AJ_Arg arg;
+    duk_size_t num;
+    duk_size_t i;
+    uint8_t* buf;
+
+    idx = duk_normalize_index(ctx, idx);
+    num = duk_get_length(ctx, idx);
+    buf = duk_push_fixed_buffer(ctx, num * ScalarSize(typeId));
+    for (i = 0; i < num; ++i) {
+        double n;
+
+        duk_get_prop_index(ctx, idx, (duk_uarridx_t)i);
+        n = duk_to_number(ctx, -1);
+        duk_pop(ctx);
+        switch (typeId) {
+        case AJ_ARG_BYTE:
+            buf[i] = (uint8_t)n;
+            break;
+
+        case AJ_ARG_BOOLEAN:
+            ((uint32_t*)buf)[i] = ((uint32_t)n) != 0;
+            break;
+
+        case AJ_ARG_UINT32:
+            ((uint32_t*)buf)[i] = (uint32_t)n;
+            break;
+
+        case AJ_ARG_INT32:
+            ((int32_t*)buf)[i] = (int32_t)n;
+            break;
+
+        case AJ_ARG_INT16:
+            ((int16_t*)buf)[i] = (int16_t)n;
+            break;
+
+        case AJ_ARG_UINT16:
+            ((uint16_t*)buf)[i] = (uint16_t)n;
+            break;
+
+        case AJ_ARG_DOUBLE:
+            ((double*)buf)[i] = n;
+            break;
+
+        case AJ_ARG_UINT64:
+            /* TODO this will lose precision for numbers ~> 2^53*/
+            ((uint64_t*)buf)[i] = (uint64_t)n;
+            break;
+
+        case AJ_ARG_INT64:
+            /* TODO this will lose precision for numbers ~> 2^53*/
+            ((int64_t*)buf)[i] = (int64_t)n;
+            break;
+        }
+    }
+    status = AJ_MarshalArg(msg, AJ_InitArg(&arg, typeId, AJ_ARRAY_FLAG, buf, num * ScalarSize(typeId)));
+    duk_pop(ctx);
+    return status;
+}
+
 static AJ_Status MarshalScalarArg(AJ_Message* msg, uint8_t typeId, double n)
 {
     AJ_Status status = AJ_ERR_SIGNATURE;
@@ -217,7 +304,9 @@ static AJ_Status MarshalJSArg(duk_context* ctx, AJ_Message* msg, const char* sig
             status = MarshalJSArray(ctx, msg, AJ_ARG_STRUCT, idx);
         }
     } else if (typeId == AJ_ARG_ARRAY) {
-        if (duk_is_array(ctx, idx)) {
+        if (duk_is_array(ctx, idx) && AJ_IsScalarType(*sig)) {
+            status = MarshalScalarArray(ctx, msg, *sig, idx);
+        } else if (duk_is_array(ctx, idx)) {
             status = MarshalJSArray(ctx, msg, AJ_ARG_ARRAY, idx);
         } else if (duk_is_buffer(ctx, idx) && AJ_IsScalarType(*sig)) {
             status = MarshalJSBuffer(ctx, msg, *sig, idx);
@@ -228,6 +317,242 @@ static AJ_Status MarshalJSArg(duk_context* ctx, AJ_Message* msg, const char* sig
     return status;
 }
 
+/*
+ * A marshalling plan is a precompiled form of a member signature. Scalar, string and variant types
+ * are a single opcode which is the type id. Structs, arrays and dictionary entries are the type id
+ * followed by the length of the plan for the contained elements so the executor never has to parse
+ * the signature. The first byte of a plan is the number of arguments.
+ */
+#define MAX_PLAN_LEN  (2 * 256)
+
+static AJ_Status CompileType(const char** sig, uint8_t* plan, uint16_t* pos)
+{
+    AJ_Status status = AJ_OK;
+    uint8_t typeId = *(*sig)++;
+    uint16_t lenPos;
+    uint16_t len;
+
+    if (*pos >= (MAX_PLAN_LEN - 2)) {
+        return AJ_ERR_RESOURCES;
+    }
+    plan[(*pos)++] = typeId;
+    if (AJ_IsScalarType(typeId) || AJ_IsStringType(typeId) || (typeId == AJ_ARG_VARIANT)) {
+        return AJ_OK;
+    }
+    lenPos = (*pos)++;
+    if (typeId == AJ_ARG_STRUCT) {
+        while ((status == AJ_OK) && (**sig != ')')) {
+            status = (**sig) ? CompileType(sig, plan, pos) : AJ_ERR_SIGNATURE;
+        }
+        ++(*sig);
+    } else if (typeId == AJ_ARG_ARRAY) {
+        status = CompileType(sig, plan, pos);
+    } else if (typeId == AJ_ARG_DICT_ENTRY) {
+        status = CompileType(sig, plan, pos);
+        if (status == AJ_OK) {
+            status = CompileType(sig, plan, pos);
+        }
+        if ((status == AJ_OK) && (*(*sig)++ != '}')) {
+            status = AJ_ERR_SIGNATURE;
+        }
+    } else {
+        status = AJ_ERR_SIGNATURE;
+    }
+    len = *pos - lenPos - 1;
+    if (len > 255) {
+        status = AJ_ERR_RESOURCES;
+    }
+    plan[lenPos] = (uint8_t)len;
+    return status;
+}
+
+static AJ_Status CompilePlan(const char* sig, uint8_t* plan, uint16_t* len)
+{
+    AJ_Status status = AJ_OK;
+    uint16_t pos = 1;
+
+    plan[0] = 0;
+    while ((status == AJ_OK) && *sig) {
+        status = CompileType(&sig, plan, &pos);
+        ++plan[0];
+    }
+    *len = pos;
+    return status;
+}
+
+static AJ_Status RunPlan(duk_context* ctx, AJ_Message* msg, const uint8_t** plan, duk_idx_t idx);
+
+static AJ_Status RunPlanArray(duk_context* ctx, AJ_Message* msg, uint8_t typeId, const uint8_t* elem, const uint8_t* end, duk_idx_t idx)
+{
+    AJ_Arg container;
+    AJ_Status status = AJ_MarshalContainer(msg, &container, typeId);
+    int n = 0;
+
+    while (status == AJ_OK) {
+        const uint8_t* op = elem;
+        duk_get_prop_index(ctx, idx, n++);
+        if (duk_is_undefined(ctx, -1)) {
+            duk_pop(ctx);
+            break;
+        }
+        status = RunPlan(ctx, msg, &op, duk_get_top_index(ctx));
+        duk_pop(ctx);
+        /*
+         * Struct elements each have their own plan, array elements all use the same plan
+         */
+        if (typeId == AJ_ARG_STRUCT) {
+            elem = op;
+            if ((elem == end) && (status == AJ_OK)) {
+                if (duk_has_prop_index(ctx, idx, n)) {
+                    status = AJ_ERR_SIGNATURE;
+                }
+                break;
+            }
+        }
+    }
+    if (status == AJ_OK) {
+        status = AJ_MarshalCloseContainer(msg, &container);
+    }
+    return status;
+}
+
+static AJ_Status RunPlanDict(duk_context* ctx, AJ_Message* msg, const uint8_t* entry, duk_idx_t idx)
+{
+    AJ_Arg container;
+    AJ_Status status = AJ_MarshalContainer(msg, &container, AJ_ARG_ARRAY);
+
+    if (status == AJ_OK) {
+        duk_enum(ctx, idx, DUK_ENUM_OWN_PROPERTIES_ONLY);
+        while ((status == AJ_OK) && duk_next(ctx, -1, 1)) {
+            AJ_Arg dictEntry;
+            status = AJ_MarshalContainer(msg, &dictEntry, AJ_ARG_DICT_ENTRY);
+            if (status == AJ_OK) {
+                /*
+                 * Skip the dictionary entry opcode and length
+                 */
+                const uint8_t* op = entry + 2;
+                duk_idx_t top = duk_get_top_index(ctx);
+                status = RunPlan(ctx, msg, &op, top - 1);
+                if (status == AJ_OK) {
+                    status = RunPlan(ctx, msg, &op, top);
+                }
+                if (status == AJ_OK) {
+                    status = AJ_MarshalCloseContainer(msg, &dictEntry);
+                }
+            }
+            duk_pop_2(ctx);
+        }
+        duk_pop(ctx);
+        if (status == AJ_OK) {
+            status = AJ_MarshalCloseContainer(msg, &container);
+        }
+    }
+    return status;
+}
+
+/*
+ * Marshal a single value following the plan, on return the plan has been advanced past the value
+ */
+static AJ_Status RunPlan(duk_context* ctx, AJ_Message* msg, const uint8_t** plan, duk_idx_t idx)
+{
+    AJ_Status status = AJ_ERR_SIGNATURE;
+    uint8_t typeId = *(*plan)++;
+    const uint8_t* elem;
+    const uint8_t* end;
+
+    if (AJ_IsScalarType(typeId)) {
+        return MarshalScalarArg(msg, typeId, duk_to_number(ctx, idx));
+    }
+    if (AJ_IsStringType(typeId)) {
+        return duk_is_string(ctx, idx) ? MarshalStringArg(msg, typeId, duk_get_string(ctx, idx)) : AJ_ERR_SIGNATURE;
+    }
+    if (typeId == AJ_ARG_VARIANT) {
+        return duk_is_object(ctx, idx) ? MarshalVariantArg(ctx, msg, idx) : AJ_ERR_SIGNATURE;
+    }
+    elem = *plan + 1;
+    end = elem + **plan;
+    *plan = end;
+
+    if (typeId == AJ_ARG_STRUCT) {
+        if (duk_is_array(ctx, idx)) {
+            status = RunPlanArray(ctx, msg, AJ_ARG_STRUCT, elem, end, idx);
+        }
+    } else if (typeId == AJ_ARG_ARRAY) {
+        if (duk_is_array(ctx, idx) && AJ_IsScalarType(*elem)) {
+            status = MarshalScalarArray(ctx, msg, *elem, idx);
+        } else if (duk_is_array(ctx, idx)) {
+            status = RunPlanArray(ctx, msg, AJ_ARG_ARRAY, elem, end, idx);
+        } else if (duk_is_buffer(ctx, idx) && AJ_IsScalarType(*elem)) {
+            status = MarshalJSBuffer(ctx, msg, *elem, idx);
+        } else if ((*elem == AJ_ARG_DICT_ENTRY) && duk_is_object(ctx, idx)) {
+            status = RunPlanDict(ctx, msg, elem, idx);
+        }
+    }
+    return status;
+}
+
+/*
+ * Marshal the arguments for a signal or method call. The marshalling plan for the member signature
+ * is compiled the second time a method or signal object is used and is cached on the object.
+ */
+static AJ_Status MarshalMsgArgs(duk_context* ctx, AJ_Message* msg, AJS_MsgInfo* msgInfo, duk_idx_t numArgs)
+{
+    AJ_Status status = AJ_OK;
+    const uint8_t* plan = NULL;
+    duk_size_t planLen = 0;
+    duk_idx_t idx;
+
+    if (msgInfo->sends < 2) {
+        ++msgInfo->sends;
+    }
+    if (msgInfo->sends > 1) {
+        duk_push_this(ctx);
+        duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("plan"));
+        plan = duk_get_buffer(ctx, -1, &planLen);
+        duk_pop(ctx);
+        if (!plan && msg->signature) {
+            uint8_t buf[MAX_PLAN_LEN];
+            uint16_t len;
+            if (CompilePlan(msg->signature, buf, &len) == AJ_OK) {
+                /*
+                 * Instances of a cached method or signal object share the plan through the cached
+                 * object which is their prototype.
+                 */
+                duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("shared"));
+                if (duk_to_boolean(ctx, -1)) {
+                    duk_get_prototype(ctx, -2);
+                } else {
+                    duk_dup(ctx, -2);
+                }
+                duk_remove(ctx, -2);
+                duk_push_string(ctx, AJS_HIDDEN_PROP("plan"));
+                plan = duk_push_fixed_buffer(ctx, len);
+                memcpy((void*)plan, buf, len);
+                planLen = len;
+                duk_def_prop(ctx, -3, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_WRITABLE);
+                duk_pop(ctx);
+            } else {
+                AJ_WarnPrintf(("Unable to compile marshalling plan for \"%s\"\n", msg->signature));
+            }
+        }
+        duk_pop(ctx);
+    }
+    if (plan) {
+        const uint8_t* op = plan + 1;
+        if (numArgs > plan[0]) {
+            return AJ_ERR_SIGNATURE;
+        }
+        for (idx = 0; (idx < numArgs) && (status == AJ_OK); ++idx) {
+            status = RunPlan(ctx, msg, &op, idx);
+        }
+    } else {
+        for (idx = 0; (idx < numArgs) && (status == AJ_OK); ++idx) {
+            status = MarshalJSArg(ctx, msg, NULL, idx);
+        }
+    }
+    return status;
+}
+
 static AJ_Status MarshalProp(duk_context* ctx, AJ_Message* msg, const char* propSig, duk_idx_t idx)
 {
     AJ_Status status = AJ_MarshalVariant(msg, propSig);
@@ -257,6 +582,7 @@ static AJ_Status MarshalPropEntry(duk_context* ctx, AJ_Message* msg, const char*
 static AJ_Status MarshalProperties(duk_context* ctx, AJ_Message* msg, const char* iface, duk_idx_t idx)
 {
     AJ_Arg propList;
+    const AJS_PropDesc* desc;
     AJ_Status status = AJ_MarshalContainer(msg, &propList, AJ_ARG_ARRAY);
 
     if (status != AJ_OK) {
@@ -275,56 +601,138 @@ static AJ_Status MarshalProperties(duk_context* ctx, AJ_Message* msg, const char
         duk_error(ctx, DUK_ERR_TYPE_ERROR, "Requires object with values for each property to be returned");
     }
     /*
-     * Ok if there are no interfaces
+     * Iterate over the readable properties in the interface, ok if the interface doesn't exist
      */
-    AJS_GetAllJoynProperty(ctx, "interfaceDefinition");
-    if (!duk_is_object(ctx, -1) || NumProps(ctx, -1) == 0) {
+    for (desc = AJS_GetPropertyDescriptors(iface); desc && desc->name && (status == AJ_OK); ++desc) {
+        /*
+         * Is there is a value for this property
+         */
+        duk_get_prop_string(ctx, idx, desc->name);
+        if (!duk_is_undefined(ctx, -1)) {
+            status = MarshalPropEntry(ctx, msg, desc->name, desc->sig, -1);
+        }
         duk_pop(ctx);
-        goto ExitProps;
     }
-    /*
-     * Ok if the interface doesn't exsit
-     */
-    duk_get_prop_string(ctx, -1, iface);
-    if (!duk_is_object(ctx, -1)) {
+
+ExitProps:
+
+    if (status == AJ_OK) {
+        AJ_MarshalCloseContainer(msg, &propList);
+    }
+    return status;
+}
+
+static uint8_t cacheGetAll = FALSE;
+
+void AJS_EnableGetAllCache(uint8_t enable)
+{
+    cacheGetAll = enable;
+}
+
+/*
+ * The cached replies are held in the "getAllCache" stash object keyed by object path and then by
+ * interface name.
+ */
+
+/*
+ * Save a copy of the marshalled body of a GetAll reply. The complete body is still in the transmit
+ * buffer because the reply has not been delivered yet. Encrypted replies, which includes all replies
+ * for secure interfaces, are not cached.
+ */
+static void CacheProperties(duk_context* ctx, AJ_Message* msg, const char* path, const char* iface)
+{
+    const uint8_t* body = msg->bus->sock.tx.writePtr - msg->bodyBytes;
+    void* buf;
+
+    if (msg->hdr->flags & AJ_FLAG_ENCRYPTED) {
+        return;
+    }
+    AJS_GetGlobalStashObject(ctx, "getAllCache");
+    if (!duk_get_prop_string(ctx, -1, path)) {
+        duk_pop(ctx);
+        duk_push_object(ctx);
+        duk_dup_top(ctx);
+        duk_put_prop_string(ctx, -3, path);
+    }
+    buf = duk_push_fixed_buffer(ctx, msg->bodyBytes);
+    memcpy(buf, body, msg->bodyBytes);
+    duk_put_prop_string(ctx, -2, iface);
+    duk_pop_2(ctx);
+}
+
+uint8_t AJS_ReplyCachedProperties(duk_context* ctx, AJ_Message* msg, const char* iface)
+{
+    AJ_Status status;
+    AJ_Message reply;
+    const void* body;
+    duk_size_t len;
+
+    if (!cacheGetAll || !iface || !msg->objPath || (msg->hdr->flags & AJ_FLAG_ENCRYPTED)) {
+        return FALSE;
+    }
+    AJS_GetGlobalStashObject(ctx, "getAllCache");
+    if (duk_get_prop_string(ctx, -1, msg->objPath)) {
+        duk_get_prop_string(ctx, -1, iface);
+        duk_remove(ctx, -2);
+    }
+    body = duk_get_buffer(ctx, -1, &len);
+    if (!body) {
         duk_pop_2(ctx);
-        goto ExitProps;
+        return FALSE;
     }
     /*
-     * Iterate over the properties in the interface
+     * The body fitted in the transmit buffer when the reply was cached so it is marshalled in one
+     * go and nothing is sent until the reply is delivered.
      */
-    duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
-    while (duk_next(ctx, -1, 1) && (status == AJ_OK)) {
-        if (duk_is_object(ctx, -1)) {
-            if (AJS_GetIntProp(ctx, -1, "type") == AJS_MEMBER_TYPE_PROPERTY) {
-                /*
-                 * Skip write-only properties
-                 */
-                if (AJS_GetPropMemberAccess(ctx, -1) != AJS_PROP_ACCESS_W) {
-                    const char* prop = duk_get_string(ctx, -2);
-                    /*
-                     * Is there is a value for this property
-                     */
-                    duk_get_prop_string(ctx, idx, prop);
-                    if (!duk_is_undefined(ctx, -1)) {
-                        const char* sig = AJS_GetStringProp(ctx, -2, "signature");
-                        status = MarshalPropEntry(ctx, msg, prop, sig, -1);
-                    }
-                    duk_pop(ctx);
+    status = AJ_MarshalReplyMsg(msg, &reply);
+    if (status == AJ_OK) {
+        status = AJ_MarshalRaw(&reply, body, len);
+    }
+    duk_pop_2(ctx);
+    if (status != AJ_OK) {
+        /*
+         * Nothing has been sent so discard the cached reply and let the script reply
+         */
+        AJ_WarnPrintf(("Failed to marshal cached GetAll reply %s\n", AJ_StatusText(status)));
+        AJ_CloseMsg(&reply);
+        AJS_InvalidatePropertyCache(ctx, iface, msg->objPath);
+        return FALSE;
+    }
+    status = AJ_DeliverMsg(&reply);
+    if (status != AJ_OK) {
+        AJ_ErrPrintf(("Failed to send cached GetAll reply %s\n", AJ_StatusText(status)));
+    }
+    return TRUE;
+}
 
-                }
-            }
+void AJS_InvalidatePropertyCache(duk_context* ctx, const char* iface, const char* path)
+{
+    if (!iface && !path) {
+        duk_push_global_stash(ctx);
+        duk_del_prop_string(ctx, -1, "getAllCache");
+        duk_pop(ctx);
+        return;
+    }
+    AJS_GetGlobalStashObject(ctx, "getAllCache");
+    if (!iface) {
+        duk_del_prop_string(ctx, -1, path);
+    } else if (path) {
+        if (duk_get_prop_string(ctx, -1, path)) {
+            duk_del_prop_string(ctx, -1, iface);
         }
-        duk_pop_2(ctx);
+        duk_pop(ctx);
+    } else {
+        /*
+         * Discard the cached replies for the interface on all objects
+         */
+        duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
+        while (duk_next(ctx, -1, TRUE)) {
+            duk_del_prop_string(ctx, -1, iface);
+            duk_pop_2(ctx);
+        }
+        duk_pop(ctx);
     }
     duk_pop(ctx);
-
-ExitProps:
-
-    if (status == AJ_OK) {
-        AJ_MarshalCloseContainer(msg, &propList);
-    }
-    return status;
 }
 
 static AJ_Status MarshalPropSet(duk_context* ctx, AJ_Message* msg)
@@ -357,27 +765,154 @@ static uint8_t IsSetProp(AJ_Message* msg)
     return (msg->hdr->msgType == AJ_MSG_METHOD_CALL) && (strcmp(msg->iface, AJ_PropertiesIface[0] + 1) == 0) && ((msg->msgId & 0xFF) == AJ_PROP_SET);
 }
 
+/*
+ * Set while a stream read function is running. The partial message owns the transmit buffer so no
+ * other message can be marshalled until the stream is complete.
+ */
+static uint8_t streaming;
+
+uint8_t AJS_IsStreaming(void)
+{
+    return streaming;
+}
+
+void AJS_CheckNotStreaming(duk_context* ctx, const char* func)
+{
+    if (streaming) {
+        duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "%s: not allowed from a stream read function", func);
+    }
+}
+
+/*
+ * If the value at idx is a Duktape.Buffer object replace it with the plain buffer it wraps
+ */
+static void UnwrapBufferObject(duk_context* ctx, duk_idx_t idx)
+{
+    idx = duk_normalize_index(ctx, idx);
+    if (!duk_is_object(ctx, idx)) {
+        return;
+    }
+    duk_get_global_string(ctx, "Duktape");
+    duk_get_prop_string(ctx, -1, "Buffer");
+    duk_get_prop_string(ctx, -1, "prototype");
+    duk_get_prototype(ctx, idx);
+    if (duk_strict_equals(ctx, -1, -2)) {
+        duk_get_prop_string(ctx, idx, "valueOf");
+        duk_dup(ctx, idx);
+        if ((duk_pcall_method(ctx, 0) == DUK_EXEC_SUCCESS) && duk_is_buffer(ctx, -1)) {
+            duk_replace(ctx, idx);
+        } else {
+            duk_pop(ctx);
+        }
+    }
+    duk_pop_n(ctx, 4);
+}
+
+/*
+ * Stream a byte array argument directly into the transmit buffer. The data is either a buffer or a
+ * total length and a function that is called to read the data in chunks so the complete byte array
+ * never needs to be held in memory. The message is delivered in parts as the transmit buffer fills.
+ *
+ * If the read function fails the rest of the byte array is zero padded and readFailed is set, the
+ * caller must still deliver the message so the framing is kept intact.
+ */
+static AJ_Status MarshalStream(duk_context* ctx, AJ_Message* msg, duk_idx_t numArgs, uint8_t* readFailed)
+{
+    AJ_Status status;
+    uint32_t len;
+    uint32_t offset = 0;
+    const void* data = NULL;
+    duk_size_t sz = 0;
+
+    if (!msg->signature || (strcmp(msg->signature, "ay") != 0)) {
+        duk_error(ctx, DUK_ERR_TYPE_ERROR, "streaming requires signature \"ay\"");
+    }
+    if (duk_is_number(ctx, 0)) {
+        if ((numArgs < 2) || !duk_is_callable(ctx, 1)) {
+            duk_error(ctx, DUK_ERR_TYPE_ERROR, "a read function is required");
+        }
+        len = duk_get_uint(ctx, 0);
+    } else {
+        UnwrapBufferObject(ctx, 0);
+        data = duk_require_buffer(ctx, 0, &sz);
+        len = (uint32_t)sz;
+    }
+    /*
+     * The array length is followed by the array data
+     */
+    status = AJ_DeliverMsgPartial(msg, sizeof(uint32_t) + len);
+    if (status == AJ_OK) {
+        status = AJ_MarshalRaw(msg, &len, sizeof(uint32_t));
+    }
+    if (data) {
+        if (status == AJ_OK) {
+            status = AJ_MarshalRaw(msg, data, len);
+        }
+        return status;
+    }
+    while ((status == AJ_OK) && (offset < len)) {
+        /*
+         * Call read(offset, remaining)
+         */
+        duk_dup(ctx, 1);
+        duk_push_uint(ctx, offset);
+        duk_push_uint(ctx, len - offset);
+        streaming = TRUE;
+        if (duk_pcall(ctx, 2) == DUK_EXEC_SUCCESS) {
+            UnwrapBufferObject(ctx, -1);
+            data = duk_get_buffer(ctx, -1, &sz);
+        } else {
+            AJ_ErrPrintf(("stream read: %s\n", duk_safe_to_string(ctx, -1)));
+            data = NULL;
+        }
+        streaming = FALSE;
+        if (!data || !sz || (sz > (len - offset))) {
+            duk_pop(ctx);
+            break;
+        }
+        status = AJ_MarshalRaw(msg, data, sz);
+        offset += (uint32_t)sz;
+        duk_pop(ctx);
+    }
+    /*
+     * Once a partial message has been started the promised length must be sent so if the read
+     * function failed pad the message, the error is reported after the message is delivered.
+     */
+    if ((status == AJ_OK) && (offset < len)) {
+        uint8_t pad[32];
+        memset(pad, 0, sizeof(pad));
+        while ((status == AJ_OK) && (offset < len)) {
+            uint32_t n = min(len - offset, sizeof(pad));
+            status = AJ_MarshalRaw(msg, pad, n);
+            offset += n;
+        }
+        *readFailed = TRUE;
+    }
+    return status;
+}
+
 /*
  * Unpack the message header fields for a SIGNAL or METHOD call
  */
 /*
  * Called with a list of args
  */
-int AJS_MarshalSignal(duk_context* ctx)
+static int MarshalSignal(duk_context* ctx, uint8_t stream)
 {
     AJ_Status status = AJ_OK;
     AJS_MsgInfo* msgInfo;
     AJ_Message msg;
     duk_idx_t numArgs = duk_get_top(ctx);
     AJ_BusAttachment* aj = AJS_GetBusAttachment();
-    duk_idx_t idx;
     const char* dest;
     uint8_t flags = 0;
     uint16_t ttl = 0;
+    uint8_t readFailed = FALSE;
 
     if (!AJS_IsRunning()) {
         duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "signal.send: not attached to AllJoyn");
     }
+    AJS_CheckNotStreaming(ctx, "signal.send");
     duk_push_this(ctx);
     duk_get_prop_string(ctx, -1, "info");
     msgInfo = duk_get_buffer(ctx, -1, NULL);
@@ -425,36 +960,147 @@ int AJS_MarshalSignal(duk_context* ctx)
         dest = msgInfo->dest;
     }
     status = AJ_MarshalSignal(aj, &msg, msgInfo->msgId, dest, msgInfo->session, flags, ttl);
-    for (idx = 0; (idx < numArgs) && (status == AJ_OK); ++idx) {
-        status = MarshalJSArg(ctx, &msg, NULL, idx);
+    if (status == AJ_OK) {
+        if (stream) {
+            status = MarshalStream(ctx, &msg, numArgs, &readFailed);
+        } else {
+            status = MarshalMsgArgs(ctx, &msg, msgInfo, numArgs);
+        }
     }
     if (status == AJ_OK) {
         status = AJ_DeliverMsg(&msg);
     }
     if (status != AJ_OK) {
-        duk_error(ctx, DUK_ERR_TYPE_ERROR, "signal.send: %s", AJ_StatusText(status));
+        duk_error(ctx, DUK_ERR_TYPE_ERROR, "signal.%s: %s", stream ? "sendStream" : "send", AJ_StatusText(status));
+    }
+    if (readFailed) {
+        duk_error(ctx, DUK_ERR_ERROR, "signal.sendStream: read function failed, data was zero padded");
     }
     return 1;
 }
 
-static int NativeReplySetter(duk_context* ctx)
+/*
+ * Called with a list of args
+ */
+int AJS_MarshalSignal(duk_context* ctx)
 {
-    uint32_t replySerial;
+    return MarshalSignal(ctx, FALSE);
+}
+
+/*
+ * Called with a buffer or a length and read function
+ */
+int AJS_MarshalSignalStream(duk_context* ctx)
+{
+    return MarshalSignal(ctx, TRUE);
+}
+
+/*
+ * The reply objects for calls that are waiting for a reply are held in the "onReply" stash object
+ * indexed by reply serial number. Each entry has a timer that removes it if the reply never
+ * arrives. The timer is a backstop for the method call timeout in the thin client which is not
+ * applied if the thin client ran out of reply contexts, the slack lets the thin client timeout
+ * error reply arrive first.
+ */
+#define REPLY_TIMEOUT_SLACK  1000
+
+/*
+ * The timeout the thin client applies to a method call made with a zero timeout
+ */
+#ifndef AJ_DEFAULT_REPLY_TIMEOUT
+#define AJ_DEFAULT_REPLY_TIMEOUT  (1000 * 20)
+#endif
+
+static AJS_CallStats callStats;
+
+void AJS_GetCallStats(AJS_CallStats* stats)
+{
+    *stats = callStats;
+}
+
+void AJS_InitReplyTable(duk_context* ctx)
+{
+    duk_push_global_stash(ctx);
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -2, "onReply");
+    duk_pop(ctx);
+    callStats.outstanding = 0;
+}
 
+static int NativeReplySetter(duk_context* ctx)
+{
     if (!duk_is_callable(ctx, 0)) {
         duk_error(ctx, DUK_ERR_TYPE_ERROR, "onReply requires a function");
     }
     duk_push_this(ctx);
-    duk_get_prop_string(ctx, -1, "replySerial");
-    replySerial = duk_get_int(ctx, -1);
-    AJS_GetGlobalStashObject(ctx, "onReply");
+    duk_push_string(ctx, AJS_HIDDEN_PROP("onReply"));
     duk_dup(ctx, 0);
-    duk_put_prop_index(ctx, -2, replySerial);
-    duk_pop_3(ctx);
+    duk_def_prop(ctx, -3, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_WRITABLE | DUK_DEFPROP_WRITABLE);
+    duk_pop(ctx);
     return 0;
 }
 
-void AJS_PushReplyObject(duk_context* ctx, uint32_t replySerial)
+/*
+ * Called with the onReply stash object on the top of the stack. Removes the reply object for a
+ * reply serial number leaving the reply object on the top of the stack in place of the stash object.
+ * Returns FALSE and pushes undefined if there is no reply object for the serial number.
+ */
+static uint8_t RemoveReplyObject(duk_context* ctx, uint32_t replySerial)
+{
+    duk_get_prop_index(ctx, -1, replySerial);
+    if (!duk_is_object(ctx, -1)) {
+        duk_remove(ctx, -2);
+        return FALSE;
+    }
+    duk_del_prop_index(ctx, -2, replySerial);
+    duk_remove(ctx, -2);
+    --callStats.outstanding;
+    return TRUE;
+}
+
+/*
+ * Called with a reply object on the top of the stack. Pops the reply object and calls the onTimeout
+ * function if one was registered.
+ */
+static void CallReplyTimeout(duk_context* ctx)
+{
+    ++callStats.timedOut;
+    duk_get_prop_string(ctx, -1, "onTimeout");
+    if (duk_is_callable(ctx, -1)) {
+        duk_swap_top(ctx, -2);
+        if (duk_pcall_method(ctx, 0) != DUK_EXEC_SUCCESS) {
+            AJS_ConsoleSignalError(ctx);
+        }
+    } else {
+        duk_pop(ctx);
+    }
+    duk_pop(ctx);
+}
+
+static int ReplyTimeout(duk_context* ctx)
+{
+    uint32_t replySerial;
+
+    duk_push_current_function(ctx);
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("serial"));
+    replySerial = duk_get_uint(ctx, -1);
+    duk_pop_2(ctx);
+
+    AJ_WarnPrintf(("Reply for serial %u timed out\n", replySerial));
+    AJS_GetGlobalStashObject(ctx, "onReply");
+    if (RemoveReplyObject(ctx, replySerial)) {
+        /*
+         * The timer has already run so must not be cleared
+         */
+        duk_del_prop_string(ctx, -1, AJS_HIDDEN_PROP("timer"));
+        CallReplyTimeout(ctx);
+    } else {
+        duk_pop(ctx);
+    }
+    return 0;
+}
+
+void AJS_PushBareReplyObject(duk_context* ctx, uint32_t replySerial)
 {
     duk_push_object(ctx);
     duk_push_int(ctx, replySerial);
@@ -463,9 +1109,71 @@ void AJS_PushReplyObject(duk_context* ctx, uint32_t replySerial)
 }
 
 /*
- * Called with a list of args
+ * A zero timeout means the call was made with the thin client default timeout
  */
-int AJS_MarshalMethodCall(duk_context* ctx)
+static void PushReplyObject(duk_context* ctx, uint32_t replySerial, uint32_t timeout)
+{
+    duk_idx_t objIdx = duk_get_top(ctx);
+
+    if (!timeout) {
+        timeout = AJ_DEFAULT_REPLY_TIMEOUT;
+    }
+    AJS_PushBareReplyObject(ctx, replySerial);
+
+    duk_push_string(ctx, AJS_HIDDEN_PROP("timer"));
+    duk_push_c_function(ctx, ReplyTimeout, 0);
+    duk_push_uint(ctx, replySerial);
+    duk_put_prop_string(ctx, -2, AJS_HIDDEN_PROP("serial"));
+    duk_push_int(ctx, AJS_SetTimeout(ctx, timeout + REPLY_TIMEOUT_SLACK));
+    duk_def_prop(ctx, objIdx, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_CONFIGURABLE | DUK_DEFPROP_CONFIGURABLE);
+
+    AJS_GetGlobalStashObject(ctx, "onReply");
+    duk_dup(ctx, objIdx);
+    duk_put_prop_index(ctx, -2, replySerial);
+    duk_pop(ctx);
+    ++callStats.outstanding;
+}
+
+void AJS_PushReplyObject(duk_context* ctx, uint32_t replySerial)
+{
+    /*
+     * The bus methods are called with the thin client default timeout
+     */
+    PushReplyObject(ctx, replySerial, 0);
+}
+
+uint8_t AJS_PushReplyHandler(duk_context* ctx, AJ_Message* msg)
+{
+    uint8_t timedOut = (msg->hdr->msgType == AJ_MSG_ERROR) && msg->error && (strcmp(msg->error, AJ_ErrTimeout) == 0);
+
+    AJS_GetGlobalStashObject(ctx, "onReply");
+    if (!RemoveReplyObject(ctx, msg->replySerial)) {
+        return TRUE;
+    }
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("timer"));
+    AJS_ClearTimeout(ctx, duk_get_int(ctx, -1));
+    duk_pop(ctx);
+    if (timedOut) {
+        /*
+         * If there is no onTimeout function the timeout error is passed to the onReply function
+         */
+        duk_get_prop_string(ctx, -1, "onTimeout");
+        if (duk_is_callable(ctx, -1)) {
+            duk_pop(ctx);
+            CallReplyTimeout(ctx);
+            return FALSE;
+        }
+        duk_pop(ctx);
+        ++callStats.timedOut;
+    } else {
+        ++callStats.completed;
+    }
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("onReply"));
+    duk_remove(ctx, -2);
+    return TRUE;
+}
+
+static int MarshalMethodCall(duk_context* ctx, uint8_t stream)
 {
     AJ_Status status = AJ_OK;
     AJS_MsgInfo* msgInfo;
@@ -475,10 +1183,12 @@ int AJS_MarshalMethodCall(duk_context* ctx)
     uint8_t flags = 0;
     uint16_t timeout = 0;
     uint32_t replySerial = 0;
+    uint8_t readFailed = FALSE;
 
     if (!AJS_IsRunning()) {
         duk_error(ctx, DUK_ERR_INTERNAL_ERROR, "method.call: not attached to AllJoyn");
     }
+    AJS_CheckNotStreaming(ctx, "method.call");
     duk_push_this(ctx);
     duk_get_prop_string(ctx, -1, "info");
     msgInfo = duk_get_buffer(ctx, -1, NULL);
@@ -504,6 +1214,20 @@ int AJS_MarshalMethodCall(duk_context* ctx)
         flags |= AJ_FLAG_NO_REPLY_EXPECTED;
     }
     duk_pop_2(ctx);
+    /*
+     * Apply backpressure if there are too many calls waiting for a reply
+     */
+    if (!(flags & AJ_FLAG_NO_REPLY_EXPECTED)) {
+        uint32_t maxCalls;
+        AJS_GetAllJoynProperty(ctx, "config");
+        duk_get_prop_string(ctx, -1, "maxCalls");
+        maxCalls = duk_get_uint(ctx, -1);
+        duk_pop_2(ctx);
+        if (maxCalls && (callStats.outstanding >= maxCalls)) {
+            ++callStats.rejected;
+            duk_error(ctx, DUK_ERR_RANGE_ERROR, "method.%s: too many outstanding calls", stream ? "callStream" : "call");
+        }
+    }
 
     AJ_ASSERT(numArgs == duk_get_top(ctx));
 
@@ -511,12 +1235,13 @@ int AJS_MarshalMethodCall(duk_context* ctx)
         flags |= AJ_FLAG_ENCRYPTED;
     }
     status = AJ_MarshalMethodCall(aj, &msg, msgInfo->msgId, msgInfo->dest, msgInfo->session, flags, timeout);
-    if (IsSetProp(&msg)) {
-        status = MarshalPropSet(ctx, &msg);
-    } else {
-        duk_idx_t idx;
-        for (idx = 0; (idx < numArgs) && (status == AJ_OK); ++idx) {
-            status = MarshalJSArg(ctx, &msg, NULL, idx);
+    if (status == AJ_OK) {
+        if (stream) {
+            status = MarshalStream(ctx, &msg, numArgs, &readFailed);
+        } else if (IsSetProp(&msg)) {
+            status = MarshalPropSet(ctx, &msg);
+        } else {
+            status = MarshalMsgArgs(ctx, &msg, msgInfo, numArgs);
         }
     }
     if (status == AJ_OK) {
@@ -525,7 +1250,10 @@ int AJS_MarshalMethodCall(duk_context* ctx)
         status = AJ_DeliverMsg(&msg);
     }
     if (status != AJ_OK) {
-        duk_error(ctx, DUK_ERR_TYPE_ERROR, "method.call: %s", AJ_StatusText(status));
+        duk_error(ctx, DUK_ERR_TYPE_ERROR, "method.%s: %s", stream ? "callStream" : "call", AJ_StatusText(status));
+    }
+    if (readFailed) {
+        duk_error(ctx, DUK_ERR_ERROR, "method.callStream: read function failed, data was zero padded");
     }
     /*
      * Push the reply object - this is the return value from this function and used to register a reply handler.
@@ -533,11 +1261,27 @@ int AJS_MarshalMethodCall(duk_context* ctx)
     if (flags & AJ_FLAG_NO_REPLY_EXPECTED) {
         duk_push_undefined(ctx);
     } else {
-        AJS_PushReplyObject(ctx, replySerial);
+        PushReplyObject(ctx, replySerial, timeout);
     }
     return 1;
 }
 
+/*
+ * Called with a list of args
+ */
+int AJS_MarshalMethodCall(duk_context* ctx)
+{
+    return MarshalMethodCall(ctx, FALSE);
+}
+
+/*
+ * Called with a buffer or a length and read function
+ */
+int AJS_MarshalMethodCallStream(duk_context* ctx)
+{
+    return MarshalMethodCall(ctx, TRUE);
+}
+
 static int HandleReply(duk_context* ctx, const char* error)
 {
     AJ_Status status = AJ_OK;
@@ -547,6 +1291,7 @@ static int HandleReply(duk_context* ctx, const char* error)
     AJS_ReplyInternal* msgReply;
     AJ_Message call;
 
+    AJS_CheckNotStreaming(ctx, error ? "errorReply" : "reply");
     duk_push_this(ctx);
     /*
      * We stored information about the call in the message object
@@ -560,6 +1305,15 @@ static int HandleReply(duk_context* ctx, const char* error)
     if (msgReply->serialNum == 0) {
         duk_error(ctx, DUK_ERR_RANGE_ERROR, "reply already sent");
     }
+    /*
+     * Cancel the timeout if this is a deferred reply
+     */
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("timer"));
+    if (duk_is_number(ctx, -1)) {
+        AJS_ClearTimeout(ctx, duk_get_int(ctx, -1));
+        duk_del_prop_string(ctx, -2, AJS_HIDDEN_PROP("timer"));
+    }
+    duk_pop(ctx);
     AJ_InfoPrintf(("Reply for serial %d\n", msgReply->serialNum));
     /*
      * Initialze a phoney header for the call
@@ -598,6 +1352,13 @@ static int HandleReply(duk_context* ctx, const char* error)
             } else if (msgReply->accessor == AJ_PROP_GET_ALL) {
                 duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("propIface"));
                 status = MarshalProperties(ctx, &msg, duk_require_string(ctx, -1), 0);
+                if ((status == AJ_OK) && cacheGetAll) {
+                    duk_get_prop_string(ctx, -2, AJS_HIDDEN_PROP("propPath"));
+                    if (duk_is_string(ctx, -1)) {
+                        CacheProperties(ctx, &msg, duk_get_string(ctx, -1), duk_get_string(ctx, -2));
+                    }
+                    duk_pop(ctx);
+                }
             } else {
                 duk_idx_t idx;
                 for (idx = 0; (idx < numArgs) && (status == AJ_OK); ++idx) {
@@ -629,4 +1390,103 @@ int AJS_MethodCallError(duk_context* ctx)
 {
     HandleReply(ctx, duk_require_string(ctx, 0));
     return 1;
-}
\ No newline at end of file
+}
+
+/*
+ * Called if a deferred reply has not been sent before the timeout expires
+ */
+static int DeferredReplyTimeout(duk_context* ctx)
+{
+    AJS_ReplyInternal* msgReply;
+
+    duk_push_current_function(ctx);
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("token"));
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("reply"));
+    msgReply = duk_get_buffer(ctx, -1, NULL);
+    duk_pop(ctx);
+    if (msgReply && msgReply->serialNum) {
+        AJ_WarnPrintf(("Deferred reply for serial %d timed out\n", msgReply->serialNum));
+        /*
+         * The timer has already run so must not be cleared
+         */
+        duk_del_prop_string(ctx, -1, AJS_HIDDEN_PROP("timer"));
+        duk_push_c_lightfunc(ctx, AJS_MethodCallError, 1, 0, 0);
+        duk_dup(ctx, -2);
+        duk_push_string(ctx, "deferred reply timed out");
+        if (duk_pcall_method(ctx, 1) != DUK_EXEC_SUCCESS) {
+            AJ_ErrPrintf(("%s\n", duk_safe_to_string(ctx, -1)));
+        }
+        duk_pop(ctx);
+    }
+    duk_pop_2(ctx);
+    return 0;
+}
+
+int AJS_MethodCallDefer(duk_context* ctx)
+{
+    AJS_ReplyInternal* msgReply;
+    AJS_ReplyInternal* tokenReply;
+    uint32_t timeout;
+    duk_idx_t tokenIdx;
+
+    duk_push_this(ctx);
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("reply"));
+    msgReply = duk_require_buffer(ctx, -1, NULL);
+    duk_pop(ctx);
+    if (msgReply->serialNum == 0) {
+        duk_error(ctx, DUK_ERR_RANGE_ERROR, "reply already sent");
+    }
+    if (duk_is_number(ctx, 0)) {
+        timeout = duk_get_uint(ctx, 0);
+    } else {
+        AJS_GetAllJoynProperty(ctx, "config");
+        duk_get_prop_string(ctx, -1, "replyTimeout");
+        timeout = duk_get_uint(ctx, -1);
+        duk_pop_2(ctx);
+    }
+    /*
+     * The token gets its own copy of the reply information so it does not hold a reference to the
+     * message object or the message arguments.
+     */
+    tokenIdx = duk_push_object(ctx);
+    duk_push_string(ctx, AJS_HIDDEN_PROP("reply"));
+    tokenReply = duk_push_fixed_buffer(ctx, sizeof(AJS_ReplyInternal));
+    memcpy(tokenReply, msgReply, sizeof(AJS_ReplyInternal));
+    duk_def_prop(ctx, tokenIdx, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_WRITABLE);
+    /*
+     * The reply can now only be sent from the token
+     */
+    msgReply->serialNum = 0;
+
+    duk_get_prop_string(ctx, -2, "sender");
+    duk_put_prop_string(ctx, tokenIdx, "sender");
+    if (tokenReply->accessor == AJ_PROP_GET) {
+        duk_push_string(ctx, AJS_HIDDEN_PROP("propSig"));
+        duk_get_prop_string(ctx, -3, AJS_HIDDEN_PROP("propSig"));
+        duk_def_prop(ctx, tokenIdx, DUK_DEFPROP_HAVE_VALUE);
+    } else if (tokenReply->accessor == AJ_PROP_GET_ALL) {
+        duk_push_string(ctx, AJS_HIDDEN_PROP("propIface"));
+        duk_get_prop_string(ctx, -3, AJS_HIDDEN_PROP("propIface"));
+        duk_def_prop(ctx, tokenIdx, DUK_DEFPROP_HAVE_VALUE);
+        duk_push_string(ctx, AJS_HIDDEN_PROP("propPath"));
+        duk_get_prop_string(ctx, -3, AJS_HIDDEN_PROP("propPath"));
+        duk_def_prop(ctx, tokenIdx, DUK_DEFPROP_HAVE_VALUE);
+    }
+    duk_push_c_lightfunc(ctx, AJS_MethodCallReply, DUK_VARARGS, 0, 0);
+    duk_put_prop_string(ctx, tokenIdx, "reply");
+    duk_push_c_lightfunc(ctx, AJS_MethodCallError, DUK_VARARGS, 0, 0);
+    duk_put_prop_string(ctx, tokenIdx, "errorReply");
+    /*
+     * A timeout of zero means the script takes responsibility for sending the reply
+     */
+    if (timeout) {
+        duk_push_c_function(ctx, DeferredReplyTimeout, 0);
+        duk_dup(ctx, tokenIdx);
+        duk_put_prop_string(ctx, -2, AJS_HIDDEN_PROP("token"));
+        duk_push_string(ctx, AJS_HIDDEN_PROP("timer"));
+        duk_insert(ctx, -2);
+        duk_push_int(ctx, AJS_SetTimeout(ctx, timeout));
+        duk_def_prop(ctx, tokenIdx, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_WRITABLE | DUK_DEFPROP_WRITABLE | DUK_DEFPROP_HAVE_CONFIGURABLE | DUK_DEFPROP_CONFIGURABLE);
+    }
+    return 1;
+}
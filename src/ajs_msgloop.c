@@ -34,6 +34,7 @@
 #include "ajs_util.h"
 #include "ajs_services.h"
 #include "ajs_debugger.h"
+#include "ajs_heap.h"
 
 static uint32_t hasPolicyChanged = FALSE;
 
@@ -198,8 +199,15 @@ static AJ_Status HandleMessage(duk_context* ctx, duk_idx_t ajIdx, AJ_Message* ms
 #endif
             return AJS_SessionLost(ctx, msg);
         }
-        func = "onSignal";
-        duk_get_prop_string(ctx, ajIdx, func);
+        /*
+         * Handlers registered for a specific signal take precedence over onSignal
+         */
+        if (AJS_PushMemberHandler(ctx, msg->msgId)) {
+            func = "AJ.on";
+        } else {
+            func = "onSignal";
+            duk_get_prop_string(ctx, ajIdx, func);
+        }
     } else if (msg->hdr->msgType == AJ_MSG_METHOD_CALL) {
         accessor = IsPropAccessor(msg);
         switch (accessor) {
@@ -222,18 +230,21 @@ static AJ_Status HandleMessage(duk_context* ctx, duk_idx_t ajIdx, AJ_Message* ms
         default:
             return AJ_ERR_INVALID;
         }
-        duk_get_prop_string(ctx, ajIdx, func);
+        /*
+         * Handlers registered for a specific method take precedence over onMethodCall
+         */
+        if ((accessor == AJS_NOT_ACCESSOR) && AJS_PushMemberHandler(ctx, msg->msgId)) {
+            func = "AJ.on";
+        } else {
+            duk_get_prop_string(ctx, ajIdx, func);
+        }
     } else {
         func = "onReply";
-        AJS_GetGlobalStashObject(ctx, func);
-        if (duk_is_object(ctx, -1)) {
-            duk_get_prop_index(ctx, -1, msg->replySerial);
-            duk_swap_top(ctx, -2);
-            /*
-             * Clear the onReply entry
-             */
-            duk_del_prop_index(ctx, -1, msg->replySerial);
-            duk_pop(ctx);
+        /*
+         * Nothing more to do if the reply was a timeout handled by onTimeout
+         */
+        if (!AJS_PushReplyHandler(ctx, msg)) {
+            return AJ_OK;
         }
     }
     /*
@@ -270,6 +281,13 @@ static AJ_Status HandleMessage(duk_context* ctx, duk_idx_t ajIdx, AJ_Message* ms
     } else {
         status = AJS_UnmarshalPropArgs(ctx, msg, accessor, msgIdx);
     }
+    /*
+     * A GetAll call can be answered from the cache without calling the script
+     */
+    if ((status == AJ_OK) && (accessor == AJ_PROP_GET_ALL) && AJS_ReplyCachedProperties(ctx, msg, duk_get_string(ctx, msgIdx + 1))) {
+        duk_set_top(ctx, ajIdx + 1);
+        return AJ_OK;
+    }
     if (status == AJ_OK) {
         duk_idx_t numArgs = duk_get_top(ctx) - msgIdx - 1;
         /*
@@ -356,15 +374,122 @@ static AJ_Status DoDeferredOperation(duk_context* ctx)
     return status;
 }
 
+/*
+ * If a heap pool has crossed its low-watermark give the script a chance to drop anything it is
+ * holding on to and then run the garbage collector. This is done between messages so we don't have
+ * to wait for an allocation to fail in the middle of a message handler.
+ */
+static void ServiceLowMemory(duk_context* ctx, duk_idx_t ajIdx)
+{
+    if (!AJS_HeapLowMemory()) {
+        return;
+    }
+    AJ_InfoPrintf(("Heap is low on memory\n"));
+    if (ajIdx >= 0) {
+        duk_get_prop_string(ctx, ajIdx, "onLowMemory");
+        if (duk_is_callable(ctx, -1)) {
+            duk_dup(ctx, ajIdx);
+            if (duk_pcall_method(ctx, 0) != DUK_EXEC_SUCCESS) {
+                AJS_ConsoleSignalError(ctx);
+            }
+        }
+        duk_pop(ctx);
+    }
+    duk_gc(ctx, 0);
+}
+
+/*
+ * Housekeeping performed between messages or batches of messages
+ */
+static AJ_Status ServiceLoop(duk_context* ctx, AJ_BusAttachment* aj, duk_idx_t ajIdx, uint32_t* msgTO)
+{
+    AJ_Status status;
+    uint8_t ldstate;
+
+    /*
+     * Services the internal and timeout timers and updates the timeout value for any new
+     * timers that have been registered since this function was last called.
+     */
+    status = AJS_RunTimers(ctx, msgTO);
+    if (status != AJ_OK) {
+        AJ_ErrPrintf(("Error servicing timer functions\n"));
+        return status;
+    }
+    /*
+     * Call any functions queued by the timer functions or by a previous pass
+     */
+    status = AJS_RunImmediate(ctx);
+    if (status != AJ_OK) {
+        AJ_ErrPrintf(("Error servicing immediate functions\n"));
+        return status;
+    }
+    /*
+     * Check if there are any pending I/O operations to perform.
+     */
+    status = AJS_ServiceIO(ctx);
+    if (status != AJ_OK) {
+        AJ_ErrPrintf(("Error servicing I/O functions\n"));
+        return status;
+    }
+    /*
+     * Check if any external modules have operations to perform
+     */
+    status = AJS_ServiceExtModules(ctx);
+    if (status != AJ_OK) {
+        AJ_ErrPrintf(("Error servicing external modules\n"));
+        return status;
+    }
+    /*
+     * Service any pending session joining
+     */
+    status = AJS_ServiceSessions(ctx, msgTO);
+    if (status != AJ_OK) {
+        AJ_ErrPrintf(("Error servicing sessions\n"));
+        return status;
+    }
+    /*
+     * Collect garbage if the heap is running low
+     */
+    ServiceLowMemory(ctx, ajIdx);
+
+    /*
+     * Do any announcing required
+     */
+    status = AJS_GetLockdownState(&ldstate);
+    if (status == AJ_OK && ldstate == AJS_CONSOLE_UNLOCKED) {
+        status = AJ_AboutAnnounce(aj);
+    }
+    return status;
+}
+
+static AJS_MsgLoopStats loopStats;
+
+static void EndBatch(uint32_t* batchCount)
+{
+    if (*batchCount) {
+        ++loopStats.batches;
+        loopStats.messages += *batchCount;
+        loopStats.maxBatch = max(loopStats.maxBatch, *batchCount);
+        *batchCount = 0;
+    }
+}
+
+void AJS_GetMsgLoopStats(AJS_MsgLoopStats* stats)
+{
+    *stats = loopStats;
+}
+
 AJ_Status AJS_MessageLoop(duk_context* ctx, AJ_BusAttachment* aj, duk_idx_t ajIdx)
 {
     AJ_Status status = AJ_OK;
     AJ_Message msg;
-    AJ_Time timerClock;
     uint32_t linkTO;
     uint32_t msgTO = 0x7FFFFFFF;
     duk_idx_t top = duk_get_top_index(ctx);
-    uint8_t ldstate;
+    uint32_t batchSize = 1;
+    uint32_t batchTime = 0;
+    uint32_t batchCount = 0;
+    AJ_Time batchTimer;
 
     AJ_InfoPrintf(("AJS_MessageLoop top=%d\n", (int)top));
 
@@ -377,8 +502,37 @@ AJ_Status AJS_MessageLoop(duk_context* ctx, AJ_BusAttachment* aj, duk_idx_t ajId
         duk_get_prop_string(ctx, ajIdx, "config");
         duk_get_prop_string(ctx, ajIdx, "linkTimeout");
         linkTO = duk_get_int(ctx, -1);
-        duk_pop_2(ctx);
+        duk_pop(ctx);
         AJ_SetBusLinkTimeout(aj, linkTO);
+        /*
+         * Read the batch size and time limit for receiving messages without housekeeping, a time
+         * limit of zero means the batch is only limited by the batch size.
+         */
+        duk_get_prop_string(ctx, -1, "batchSize");
+        batchSize = max(duk_get_int(ctx, -1), 1);
+        duk_get_prop_string(ctx, -2, "batchTime");
+        batchTime = max(duk_get_int(ctx, -1), 0);
+        duk_pop_2(ctx);
+        /*
+         * Read the message object mode
+         */
+        duk_get_prop_string(ctx, -1, "lazyMessages");
+        AJS_SetLazyMessages(duk_to_boolean(ctx, -1));
+        duk_pop(ctx);
+        /*
+         * Read if marshalled GetAll replies are cached
+         */
+        duk_get_prop_string(ctx, -1, "cacheGetAll");
+        AJS_EnableGetAllCache(duk_to_boolean(ctx, -1));
+        duk_pop(ctx);
+        /*
+         * Read the session join concurrency limit, retry backoff and reply timeout
+         */
+        duk_get_prop_string(ctx, -1, "maxJoins");
+        duk_get_prop_string(ctx, -2, "joinBackoff");
+        duk_get_prop_string(ctx, -3, "joinTimeout");
+        AJS_SetJoinSchedule((uint8_t)min(max(duk_get_int(ctx, -3), 0), 255), max(duk_get_int(ctx, -2), 0), max(duk_get_int(ctx, -1), 1));
+        duk_pop_n(ctx, 4);
     }
     AJ_ASSERT(duk_get_top_index(ctx) == top);
 
@@ -386,22 +540,8 @@ AJ_Status AJS_MessageLoop(duk_context* ctx, AJ_BusAttachment* aj, duk_idx_t ajId
      * Initialize About we can start sending announcements
      */
     AJ_AboutInit(aj, AJS_APP_PORT);
-    /*
-     * timer clock must be initialized
-     */
-    AJ_InitTimer(&timerClock);
-
 
     while (status == AJ_OK) {
-        /*
-         * Services the internal and timeout timers and updates the timeout value for any new
-         * timers that have been registered since this function was last called.
-         */
-        status = AJS_RunTimers(ctx, &timerClock, &msgTO);
-        if (status != AJ_OK) {
-            AJ_ErrPrintf(("Error servicing timer functions\n"));
-            break;
-        }
         /*
          * Check we are cleaning up the duktape stack correctly.
          */
@@ -416,39 +556,13 @@ AJ_Status AJS_MessageLoop(duk_context* ctx, AJ_BusAttachment* aj, duk_idx_t ajId
          */
         AJS_ClearPins(ctx);
         /*
-         * Check if there are any pending I/O operations to perform.
+         * The housekeeping is skipped while a batch of messages is being received
          */
-        status = AJS_ServiceIO(ctx);
-        if (status != AJ_OK) {
-            AJ_ErrPrintf(("Error servicing I/O functions\n"));
-            break;
-        }
-        /*
-         * Check if any external modules have operations to perform
-         */
-        status = AJS_ServiceExtModules(ctx);
-        if (status != AJ_OK) {
-            AJ_ErrPrintf(("Error servicing external modules\n"));
-            break;
-        }
-        /*
-         * Service any pending session joining
-         */
-        status = AJS_ServiceSessions(ctx);
-        if (status != AJ_OK) {
-            AJ_ErrPrintf(("Error servicing sessions\n"));
-            break;
-        }
-
-        /*
-         * Do any announcing required
-         */
-        status = AJS_GetLockdownState(&ldstate);
-        if (status == AJ_OK && ldstate == AJS_CONSOLE_UNLOCKED) {
-            status = AJ_AboutAnnounce(aj);
-        }
-        if (status != AJ_OK) {
-            break;
+        if (batchCount == 0) {
+            status = ServiceLoop(ctx, aj, ajIdx, &msgTO);
+            if (status != AJ_OK) {
+                break;
+            }
         }
         /*
          * This special wildcard allows us to unmarshal signals with any source path
@@ -456,9 +570,16 @@ AJ_Status AJS_MessageLoop(duk_context* ctx, AJ_BusAttachment* aj, duk_idx_t ajId
         AJS_SetObjectPath("!");
         /*
          * Block until a message is received, the timeout expires, or the operation is interrupted.
+         * Don't block if there are immediate functions waiting to be called or if we are receiving
+         * a batch of messages.
          */
-        status = AJ_UnmarshalMsg(aj, &msg, msgTO);
+        status = AJ_UnmarshalMsg(aj, &msg, (batchCount || AJS_ImmediatePending()) ? 0 : msgTO);
         if (status != AJ_OK) {
+            /*
+             * The batch ends on any error, including a message that was discarded, so the
+             * housekeeping runs and the batch statistics are kept
+             */
+            EndBatch(&batchCount);
             if ((status == AJ_ERR_INTERRUPTED) || (status == AJ_ERR_TIMEOUT)) {
                 status = AJ_OK;
                 continue;
@@ -470,6 +591,9 @@ AJ_Status AJS_MessageLoop(duk_context* ctx, AJ_BusAttachment* aj, duk_idx_t ajId
             continue;
         }
 
+        if (batchCount++ == 0) {
+            AJ_InitTimer(&batchTimer);
+        }
         ProcessPolicyNotifications(ctx, ajIdx);
 
         switch (msg.msgId) {
@@ -562,6 +686,12 @@ AJ_Status AJS_MessageLoop(duk_context* ctx, AJ_BusAttachment* aj, duk_idx_t ajId
          * Free message resources
          */
         AJ_CloseMsg(&msg);
+        /*
+         * Call any functions queued by the message handler
+         */
+        if (status == AJ_OK) {
+            status = AJS_RunImmediate(ctx);
+        }
         /*
          * Decide which messages should cause us to exit
          */
@@ -590,7 +720,14 @@ AJ_Status AJS_MessageLoop(duk_context* ctx, AJ_BusAttachment* aj, duk_idx_t ajId
         if (status == AJ_OK) {
             status = DoDeferredOperation(ctx);
         }
+        /*
+         * Go back to the housekeeping when the batch is full or has taken too long
+         */
+        if ((batchCount >= batchSize) || (batchTime && (AJ_GetElapsedTime(&batchTimer, TRUE) >= batchTime))) {
+            EndBatch(&batchCount);
+        }
     }
+    EndBatch(&batchCount);
     AJS_ClearPins(ctx);
     AJS_ClearWatchdogTimer();
     return status;
@@ -51,11 +51,37 @@ typedef enum {
     AJS_SVC_AUTH_ERROR      = 4     /* An error occurred */
 } AuthStatus;
 
+/*
+ * The session table size, this is the maximum number of peers that can have a session or a
+ * session join in progress. Must be a power of 2 and no more than 32768. The build sets this for
+ * each target, the default is sized for a gateway that discovers many devices.
+ */
+#ifndef AJS_MAX_SESSIONS
+#define AJS_MAX_SESSIONS 128
+#endif
+
+#if (AJS_MAX_SESSIONS & (AJS_MAX_SESSIONS - 1)) || (AJS_MAX_SESSIONS > 32768)
+#error "AJS_MAX_SESSIONS must be a power of 2 and no more than 32768"
+#endif
+
+/*
+ * The hash indices are twice the size of the table to keep the probe sequences short
+ */
+#define INDEX_SIZE  (2 * AJS_MAX_SESSIONS)
+#define INDEX_MASK  (INDEX_SIZE - 1)
+
 typedef struct {
+    const char* peer;     /* Interned peer name, NULL if the entry is free */
+    uint32_t hash;        /* Hash of the peer name */
     uint16_t port;
     uint16_t refCount;
-    uint32_t replySerial;
     uint32_t sessionId;
+    uint32_t annoHash;    /* Hash of the object description in the last announcement */
+    uint32_t joinTime;    /* Time when a queued join can be started */
+    uint16_t joinOp;      /* Join operation + 1 for a join in progress, zero if there is none */
+    uint8_t joinQueued;
+    uint8_t joinFailures;
+    uint8_t authStatus;
 } SessionInfo;
 
 typedef struct {
@@ -63,43 +89,477 @@ typedef struct {
     duk_context* ctx;
 } PeerInfo;
 
+/*
+ * Native session table. The entries are found through two open-addressed hash indices, one keyed
+ * by peer name and one keyed by session id. Index slots hold the table entry + 1, zero marks an
+ * empty slot. The peer name strings are held by the peer objects in the "peers" stash object,
+ * which is indexed by table entry, and which also holds the JavaScript state for the peer.
+ */
+static SessionInfo sessionTable[AJS_MAX_SESSIONS];
+static uint16_t nameIndex[INDEX_SIZE];
+static uint16_t sessionIndex[INDEX_SIZE];
+
+/*
+ * Queue of session table entries for peers that have finished authenticating and are waiting for
+ * the service callback to be called. An entry is only queued once so the queue cannot overflow.
+ */
+static uint16_t authQueue[AJS_MAX_SESSIONS];
+static uint8_t authQueued[AJS_MAX_SESSIONS];
+static uint16_t authHead;
+static uint16_t authCount;
+
+/*
+ * Number of times a join is attempted before the session table entry is freed
+ */
+#ifndef AJS_MAX_JOIN_ATTEMPTS
+#define AJS_MAX_JOIN_ATTEMPTS 4
+#endif
+
+/*
+ * Join scheduler state. Joins are queued on the session table entry and started by
+ * AJS_ServiceSessions when the join time has been reached, no more than maxJoins joins are in
+ * progress at a time. Failed joins, and joins that have no reply after joinTimeout, are requeued
+ * with an exponential backoff.
+ */
+static uint8_t maxJoins = 4;
+static uint32_t joinBackoff = 1000;
+static uint32_t joinTimeout = 30000;
+static uint16_t joinsQueued;
+static AJ_Time joinClock;
+
+/*
+ * The joins that are waiting for a reply. Replies are matched on the serial number of the
+ * JOIN_SESSION call so any number of joins can be in progress and each reply is handled as it
+ * arrives. The table is kept packed, an operation is removed by moving the last one into its place.
+ */
+typedef struct {
+    uint32_t serial;   /* Serial number of the JOIN_SESSION call */
+    uint32_t start;    /* Time the JOIN_SESSION call was sent */
+    uint32_t deadline; /* Time the join is failed if there has been no reply */
+    uint16_t entry;    /* Session table entry for the peer */
+} JoinOp;
+
+static JoinOp joinOps[AJS_MAX_SESSIONS];
+static uint16_t joinsInFlight;
+
+/*
+ * Join timing, the times are in milliseconds on the join clock which starts when the session table
+ * is reset at startup.
+ */
+static uint32_t joinReplies;
+static uint32_t joinTimeTotal;
+
+static AJS_SessionStats sessionStats;
 
-static AuthStatus GetPeerStatus(duk_context* ctx, const char* peer)
+/*
+ * Sessions released while a stream was being sent, each session table entry has at most one
+ * session so this cannot overflow.
+ */
+static uint32_t pendingLeaves[AJS_MAX_SESSIONS];
+static uint16_t numPendingLeaves;
+
+/*
+ * Maximum number of distinct interface names in the service interest set
+ */
+#ifndef AJS_MAX_SERVICE_INTERESTS
+#define AJS_MAX_SERVICE_INTERESTS 32
+#endif
+
+/*
+ * The service interest set holds the sorted hashes of the interface names that have a service
+ * callback registered. Announcements are checked against the interest set before anything is
+ * allocated on the JavaScript heap. A hash collision just lets an announcement through to the
+ * service callback check. If the set overflows all announcements are let through.
+ */
+static uint32_t interestSet[AJS_MAX_SERVICE_INTERESTS];
+static uint8_t interestRefs[AJS_MAX_SERVICE_INTERESTS];
+static uint8_t numInterests;
+static uint16_t interestOverflow;
+
+/*
+ * Accumulates a string including the terminating NUL into an FNV-1a hash
+ */
+static uint32_t HashMore(uint32_t hash, const char* str)
 {
-    duk_int_t ret;
-    AJS_GetGlobalStashObject(ctx, peer);
-    duk_get_prop_string(ctx, -1, "authStatus");
-    if (!duk_is_number(ctx, -1)) {
-        /* No peer found */
-        duk_pop_2(ctx);
-        return AJS_SVC_AUTH_ERROR;
+    do {
+        hash = (hash ^ (uint8_t)*str) * 16777619u;
+    } while (*str++);
+    return hash;
+}
+
+static uint32_t HashName(const char* name)
+{
+    return HashMore(2166136261u, name);
+}
+
+static uint32_t HashSessionId(uint32_t sessionId)
+{
+    return sessionId * 2654435761u;
+}
+
+static uint32_t EntryHash(uint16_t slot, uint8_t byId)
+{
+    SessionInfo* sessionInfo = &sessionTable[slot - 1];
+    return byId ? HashSessionId(sessionInfo->sessionId) : sessionInfo->hash;
+}
+
+static void IndexInsert(uint16_t* index, uint8_t byId, uint16_t slot)
+{
+    uint32_t i = EntryHash(slot, byId) & INDEX_MASK;
+
+    while (index[i]) {
+        i = (i + 1) & INDEX_MASK;
     }
-    ret = duk_get_int(ctx, -1);
-    duk_pop_2(ctx);
-    return (AuthStatus)ret;
+    index[i] = slot;
 }
 
 /*
- * Set the authStatus on a peer. If no peer object exists, one will be created.
+ * Linear probing with backward shift deletion so there are no tombstones to clean up
  */
-static void SetPeerStatus(duk_context* ctx, const char* peer, AuthStatus status)
+static void IndexRemove(uint16_t* index, uint8_t byId, uint16_t slot)
 {
-    AJS_GetGlobalStashObject(ctx, peer);
-    duk_get_prop_string(ctx, -1, "name");
-    if (!duk_is_string(ctx, -1)) {
-        /* Peer doesn't exist */
-        duk_pop(ctx);
-        duk_push_string(ctx, peer);
-        duk_put_prop_string(ctx, -2, "name");
-        duk_push_int(ctx, (int)status);
-        duk_put_prop_string(ctx, -2, "authStatus");
-    } else {
-        /* Peer exists, update status */
-        duk_pop(ctx);
-        duk_push_int(ctx, (int)status);
-        duk_put_prop_string(ctx, -2, "authStatus");
+    uint32_t i = EntryHash(slot, byId) & INDEX_MASK;
+    uint32_t j;
+
+    while (index[i] != slot) {
+        if (!index[i]) {
+            return;
+        }
+        i = (i + 1) & INDEX_MASK;
     }
+    index[i] = 0;
+    for (j = (i + 1) & INDEX_MASK; index[j]; j = (j + 1) & INDEX_MASK) {
+        uint32_t home = EntryHash(index[j], byId) & INDEX_MASK;
+        /*
+         * The entry can move into the hole unless its home slot lies cyclically in (i, j]
+         */
+        if ((i <= j) ? ((i < home) && (home <= j)) : ((i < home) || (home <= j))) {
+            continue;
+        }
+        index[i] = index[j];
+        index[j] = 0;
+        i = j;
+    }
+}
+
+static SessionInfo* FindSession(const char* peer)
+{
+    uint32_t hash = HashName(peer);
+    uint32_t i;
+
+    for (i = hash & INDEX_MASK; nameIndex[i]; i = (i + 1) & INDEX_MASK) {
+        SessionInfo* sessionInfo = &sessionTable[nameIndex[i] - 1];
+        if ((sessionInfo->hash == hash) && (strcmp(sessionInfo->peer, peer) == 0)) {
+            return sessionInfo;
+        }
+    }
+    return NULL;
+}
+
+static SessionInfo* FindSessionById(uint32_t sessionId)
+{
+    uint32_t i;
+
+    for (i = HashSessionId(sessionId) & INDEX_MASK; sessionIndex[i]; i = (i + 1) & INDEX_MASK) {
+        SessionInfo* sessionInfo = &sessionTable[sessionIndex[i] - 1];
+        if (sessionInfo->sessionId == sessionId) {
+            return sessionInfo;
+        }
+    }
+    return NULL;
+}
+
+static uint16_t SessionSlot(SessionInfo* sessionInfo)
+{
+    return (uint16_t)(sessionInfo - sessionTable) + 1;
+}
+
+static void SetSessionId(SessionInfo* sessionInfo, uint32_t sessionId)
+{
+    if (sessionInfo->sessionId) {
+        IndexRemove(sessionIndex, TRUE, SessionSlot(sessionInfo));
+    }
+    sessionInfo->sessionId = sessionId;
+    if (sessionId) {
+        IndexInsert(sessionIndex, TRUE, SessionSlot(sessionInfo));
+    }
+}
+
+/*
+ * Push the peer object for a session table entry
+ */
+static void PushPeerObject(duk_context* ctx, SessionInfo* sessionInfo)
+{
+    AJS_GetGlobalStashObject(ctx, "peers");
+    duk_get_prop_index(ctx, -1, SessionSlot(sessionInfo) - 1);
+    duk_remove(ctx, -2);
+}
+
+/*
+ * Get the session table entry for a peer, allocating one if there is no entry for the peer.
+ * Returns NULL if the table is full.
+ */
+static SessionInfo* AllocSession(duk_context* ctx, const char* peer)
+{
+    SessionInfo* sessionInfo = FindSession(peer);
+    size_t i;
+
+    if (sessionInfo) {
+        return sessionInfo;
+    }
+    for (i = 0; i < AJS_MAX_SESSIONS; ++i) {
+        if (!sessionTable[i].peer) {
+            break;
+        }
+    }
+    if (i == AJS_MAX_SESSIONS) {
+        AJ_WarnPrintf(("AllocSession(): session table is full\n"));
+        ++sessionStats.allocFailed;
+        return NULL;
+    }
+    sessionInfo = &sessionTable[i];
+    memset(sessionInfo, 0, sizeof(SessionInfo));
+    sessionInfo->authStatus = AJS_SVC_AUTH_ERROR;
+    /*
+     * The peer object holds the interned peer name and an array "anno" which is used to accumulate
+     * announcements from the peer.
+     */
+    AJS_GetGlobalStashObject(ctx, "peers");
+    duk_push_object(ctx);
+    sessionInfo->peer = duk_push_string(ctx, peer);
+    duk_put_prop_string(ctx, -2, "name");
+    duk_push_array(ctx);
+    duk_put_prop_string(ctx, -2, "anno");
+    duk_put_prop_index(ctx, -2, i);
     duk_pop(ctx);
+    sessionInfo->hash = HashName(peer);
+    IndexInsert(nameIndex, FALSE, SessionSlot(sessionInfo));
+    return sessionInfo;
+}
+
+static void DequeueJoin(SessionInfo* sessionInfo)
+{
+    if (sessionInfo->joinQueued) {
+        sessionInfo->joinQueued = FALSE;
+        --joinsQueued;
+    }
+}
+
+static void EndJoin(SessionInfo* sessionInfo)
+{
+    if (sessionInfo->joinOp) {
+        uint16_t op = sessionInfo->joinOp - 1;
+        sessionInfo->joinOp = 0;
+        if (op != --joinsInFlight) {
+            joinOps[op] = joinOps[joinsInFlight];
+            sessionTable[joinOps[op].entry].joinOp = op + 1;
+        }
+    }
+}
+
+static void FreeSession(duk_context* ctx, SessionInfo* sessionInfo)
+{
+    uint16_t slot = SessionSlot(sessionInfo);
+
+    DequeueJoin(sessionInfo);
+    EndJoin(sessionInfo);
+    SetSessionId(sessionInfo, 0);
+    IndexRemove(nameIndex, FALSE, slot);
+    sessionInfo->peer = NULL;
+    /*
+     * Releases the peer name and any JavaScript state for the peer
+     */
+    AJS_GetGlobalStashObject(ctx, "peers");
+    duk_del_prop_index(ctx, -1, slot - 1);
+    duk_pop(ctx);
+}
+
+static void ResetSessionTable(duk_context* ctx)
+{
+    memset(sessionTable, 0, sizeof(sessionTable));
+    memset(nameIndex, 0, sizeof(nameIndex));
+    memset(sessionIndex, 0, sizeof(sessionIndex));
+    memset(authQueued, 0, sizeof(authQueued));
+    authHead = 0;
+    authCount = 0;
+    joinsQueued = 0;
+    joinsInFlight = 0;
+    numPendingLeaves = 0;
+    joinReplies = 0;
+    joinTimeTotal = 0;
+    memset(&sessionStats, 0, sizeof(sessionStats));
+    AJ_InitTimer(&joinClock);
+    AJS_ClearGlobalStashObject(ctx, "peers");
+}
+
+/*
+ * Queue a join with the peer to be started after delay milliseconds
+ */
+static void QueueJoin(SessionInfo* sessionInfo, uint32_t delay)
+{
+    if (!sessionInfo->joinQueued) {
+        sessionInfo->joinQueued = TRUE;
+        ++joinsQueued;
+    }
+    sessionInfo->joinTime = AJ_GetElapsedTime(&joinClock, TRUE) + delay;
+}
+
+/*
+ * Requeue a failed join with backoff. When the peer runs out of attempts the session table entry
+ * is freed, the next announcement from the peer starts over. The service objects accumulated for
+ * the peer are detached from the entry so their finalizers do not release a later entry.
+ */
+static void JoinFailed(duk_context* ctx, SessionInfo* sessionInfo)
+{
+    if (++sessionInfo->joinFailures < AJS_MAX_JOIN_ATTEMPTS) {
+        AJ_InfoPrintf(("JoinFailed(): Retrying join with %s\n", sessionInfo->peer));
+        ++sessionStats.joinsRetried;
+        QueueJoin(sessionInfo, joinBackoff << (sessionInfo->joinFailures - 1));
+    } else {
+        size_t i;
+        size_t numSvcs;
+
+        AJ_WarnPrintf(("JoinFailed(): Giving up join with %s\n", sessionInfo->peer));
+        ++sessionStats.joinsFailed;
+        PushPeerObject(ctx, sessionInfo);
+        duk_get_prop_string(ctx, -1, "anno");
+        numSvcs = duk_get_length(ctx, -1);
+        for (i = 0; i < numSvcs; ++i) {
+            if (duk_get_prop_index(ctx, -1, i)) {
+                duk_del_prop_string(ctx, -1, "dest");
+            }
+            duk_pop(ctx);
+        }
+        duk_pop_2(ctx);
+        FreeSession(ctx, sessionInfo);
+    }
+}
+
+/*
+ * Fail the joins that have not had a reply by their deadline so a lost reply does not hold on to a
+ * join slot. Returns the time in milliseconds until the next deadline.
+ */
+static uint32_t ExpireJoins(duk_context* ctx, uint32_t now)
+{
+    uint32_t wait = 0xFFFFFFFF;
+    uint8_t expired = FALSE;
+    uint16_t i = 0;
+
+    while (i < joinsInFlight) {
+        uint32_t left = joinOps[i].deadline - now;
+        SessionInfo* sessionInfo;
+
+        if ((int32_t)left > 0) {
+            if (left < wait) {
+                wait = left;
+            }
+            ++i;
+            continue;
+        }
+        sessionInfo = &sessionTable[joinOps[i].entry];
+        AJ_WarnPrintf(("ExpireJoins(): No reply to join with %s\n", sessionInfo->peer));
+        ++sessionStats.joinsTimedOut;
+        expired = TRUE;
+        /*
+         * The last join operation is moved into this slot
+         */
+        EndJoin(sessionInfo);
+        JoinFailed(ctx, sessionInfo);
+    }
+    if (expired && !joinsQueued && !joinsInFlight) {
+        sessionStats.allJoinedTime = now;
+    }
+    return wait;
+}
+
+/*
+ * Expire overdue joins and start the queued joins that are due while there are join slots
+ * available. Returns the time in milliseconds until the next queued join is due or the next join
+ * deadline.
+ */
+static uint32_t StartJoins(duk_context* ctx)
+{
+    AJ_BusAttachment* aj = AJS_GetBusAttachment();
+    uint32_t wait = 0xFFFFFFFF;
+    uint32_t now;
+    size_t i;
+
+    if (!joinsQueued && !joinsInFlight) {
+        return wait;
+    }
+    now = AJ_GetElapsedTime(&joinClock, TRUE);
+    wait = ExpireJoins(ctx, now);
+    for (i = 0; (i < AJS_MAX_SESSIONS) && joinsQueued; ++i) {
+        SessionInfo* sessionInfo = &sessionTable[i];
+        uint32_t delay;
+
+        if (!sessionInfo->peer || !sessionInfo->joinQueued) {
+            continue;
+        }
+        delay = sessionInfo->joinTime - now;
+        if ((int32_t)delay > 0) {
+            if (delay < wait) {
+                wait = delay;
+            }
+            continue;
+        }
+        /*
+         * The join reply for an in-progress join will wake up the message loop
+         */
+        if (maxJoins && (joinsInFlight >= maxJoins)) {
+            continue;
+        }
+        DequeueJoin(sessionInfo);
+        if (AJ_BusJoinSession(aj, sessionInfo->peer, sessionInfo->port, NULL) == AJ_OK) {
+            JoinOp* op = &joinOps[joinsInFlight++];
+            op->serial = aj->serial - 1;
+            op->start = now;
+            op->deadline = now + joinTimeout;
+            op->entry = (uint16_t)i;
+            sessionInfo->joinOp = joinsInFlight;
+            ++sessionStats.joinsStarted;
+            if (joinTimeout < wait) {
+                wait = joinTimeout;
+            }
+        } else {
+            JoinFailed(ctx, sessionInfo);
+        }
+    }
+    return wait;
+}
+
+void AJS_SetJoinSchedule(uint8_t limit, uint32_t backoff, uint32_t timeout)
+{
+    maxJoins = limit;
+    joinBackoff = backoff;
+    joinTimeout = timeout;
+}
+
+void AJS_GetSessionStats(AJS_SessionStats* stats)
+{
+    *stats = sessionStats;
+    stats->joinsQueued = joinsQueued;
+    stats->joinsInFlight = joinsInFlight;
+    stats->joinTimeAvg = joinReplies ? (joinTimeTotal / joinReplies) : 0;
+}
+
+/*
+ * Set the authStatus on a peer. Ignored if the peer no longer has a session table entry.
+ */
+static void SetPeerStatus(const char* peer, AuthStatus status)
+{
+    SessionInfo* sessionInfo = FindSession(peer);
+    if (sessionInfo) {
+        uint16_t entry = SessionSlot(sessionInfo) - 1;
+        sessionInfo->authStatus = (uint8_t)status;
+        /*
+         * Queue the peer so AJS_ServiceSessions calls the service callback
+         */
+        if ((status == AJS_SVC_AUTHENTICATED) && !authQueued[entry]) {
+            authQueued[entry] = TRUE;
+            authQueue[(authHead + authCount++) % AJS_MAX_SESSIONS] = entry;
+        }
+    }
 }
 
 static void AuthCallback(const void* context, AJ_Status status)
@@ -109,7 +569,7 @@ static void AuthCallback(const void* context, AJ_Status status)
         /*
          * Update the peers status
          */
-        SetPeerStatus(info->ctx, info->peer, (status == AJ_OK) ? AJS_SVC_AUTHENTICATED : AJS_SVC_AUTHENTICATING);
+        SetPeerStatus(info->peer, (status == AJ_OK) ? AJS_SVC_AUTHENTICATED : AJS_SVC_AUTHENTICATING);
         if (status == AJ_OK) {
             /*
              * Auth is complete, info will never be used again
@@ -132,24 +592,23 @@ static int NativeServiceObjectFinalizer(duk_context* ctx)
     duk_get_prop_string(ctx, 0, "dest");
     if (!duk_is_undefined(ctx, -1)) {
         peer = duk_get_string(ctx, -1);
-        if (peer) {
-            AJS_GetGlobalStashObject(ctx, "sessions");
-            duk_get_prop_string(ctx, -1, peer);
-            duk_get_prop_string(ctx, -1, "info");
-            sessionInfo = duk_get_buffer(ctx, -1, NULL);
-            duk_pop_2(ctx);
+        sessionInfo = peer ? FindSession(peer) : NULL;
+        if (sessionInfo) {
             AJ_ASSERT(sessionInfo->refCount != 0);
             if ((--sessionInfo->refCount == 0) && sessionInfo->sessionId) {
-                duk_del_prop_string(ctx, -1, peer);
+                uint32_t sessionId = sessionInfo->sessionId;
+                FreeSession(ctx, sessionInfo);
                 /*
-                 * Only leave the session if AllJoyn is still running
+                 * Only leave the session if AllJoyn is still running. The garbage collector can
+                 * run the finalizer from a stream read function, the session is left by
+                 * AJS_ServiceSessions once the stream is complete.
                  */
-                if (AJS_IsRunning()) {
-                    (void) AJ_BusLeaveSession(AJS_GetBusAttachment(), sessionInfo->sessionId);
+                if (AJS_IsStreaming()) {
+                    pendingLeaves[numPendingLeaves++] = sessionId;
+                } else if (AJS_IsRunning()) {
+                    (void) AJ_BusLeaveSession(AJS_GetBusAttachment(), sessionId);
                 }
-                sessionInfo->sessionId = 0;
             }
-            duk_pop(ctx);
         }
         /*
          * There is no guarantee that finalizers are only called once. This ensures that the
@@ -166,17 +625,14 @@ static int NativeServiceObjectFinalizer(duk_context* ctx)
  */
 static void CheckPeerIsAlive(duk_context* ctx, const char* peer)
 {
-    AJS_GetGlobalStashObject(ctx, "sessions");
-    if (!duk_has_prop_string(ctx, -1, peer)) {
+    if (!FindSession(peer)) {
         duk_error(ctx, DUK_ERR_REFERENCE_ERROR, "Peer has disconnected");
     }
-    duk_pop(ctx);
 }
 
 /*
- * Looks for an interface that defines a specific member.
- *
- * TODO - check for ambiguity - same member defined on multiple interfaces
+ * Looks for an interface that defines a specific member. If the member is only given by name and
+ * more than one of the service's interfaces define it the interface must be specified.
  */
 static const char* FindInterfaceForMember(duk_context* ctx, duk_idx_t mbrIdx, const char** member)
 {
@@ -214,15 +670,35 @@ static const char* FindInterfaceForMember(duk_context* ctx, duk_idx_t mbrIdx, co
          * Expect a string
          */
         *member = duk_require_string(ctx, mbrIdx);
-        for (i = 0; !found && (i < numInterfaces); ++i) {
-            duk_get_prop_index(ctx, -2, i);
-            iface = duk_require_string(ctx, -1);
-            duk_get_prop_string(ctx, listIdx, iface);
-            /*
-             * See if the requested member exists on this interface
-             */
-            found = duk_has_prop_string(ctx, -1, *member);
-            duk_pop_2(ctx);
+        /*
+         * If the member name is only defined on one interface we just need to check the service
+         * implements that interface.
+         */
+        iface = AJS_GetMemberInterface(ctx, *member);
+        if (iface) {
+            for (i = 0; !found && (i < numInterfaces); ++i) {
+                duk_get_prop_index(ctx, -2, i);
+                found = (strcmp(iface, duk_require_string(ctx, -1)) == 0);
+                duk_pop(ctx);
+            }
+        } else {
+            for (i = 0; i < numInterfaces; ++i) {
+                const char* name;
+                duk_get_prop_index(ctx, -2, i);
+                name = duk_require_string(ctx, -1);
+                duk_get_prop_string(ctx, listIdx, name);
+                /*
+                 * See if the requested member exists on this interface
+                 */
+                if (duk_has_prop_string(ctx, -1, *member)) {
+                    if (found) {
+                        duk_error(ctx, DUK_ERR_REFERENCE_ERROR, "Member '%s' is ambiguous, use { '%s':'interface-name' }", *member, *member);
+                    }
+                    found = TRUE;
+                    iface = name;
+                }
+                duk_pop_2(ctx);
+            }
         }
     }
     duk_pop_2(ctx);
@@ -284,6 +760,7 @@ static void MessageSetup(duk_context* ctx, const char* iface, const char* member
      */
     msgInfo = duk_push_fixed_buffer(ctx, sizeof(AJS_MsgInfo) + dlen + 1);
     msgInfo->secure = secure;
+    msgInfo->sends = 0;
     msgInfo->session = AJS_GetIntProp(ctx, -2, "session");
     msgInfo->msgId = msg.msgId;
     memcpy(msgInfo->dest, dest, dlen);
@@ -297,12 +774,97 @@ static void MessageSetup(duk_context* ctx, const char* iface, const char* member
     duk_remove(ctx, -2);
 }
 
+/*
+ * Incremented whenever sessions are removed so cached proxy objects that may refer to a session
+ * that has gone away are discarded.
+ */
+static uint32_t proxyGeneration = 1;
+
+/*
+ * Called with a cached method or signal object on the top of the stack. Replaces it with a new
+ * object that inherits from the cached object so properties the script sets, such as timeout, stay
+ * on the new object and are not seen by other users of the cached object.
+ */
+static void PushProxyInstance(duk_context* ctx)
+{
+    duk_push_object(ctx);
+    duk_swap_top(ctx, -2);
+    duk_set_prototype(ctx, -2);
+}
+
+/*
+ * Called with a service object on the top of the stack. If there is a cached method or signal
+ * object for the key a new instance of it replaces the service object on the top of the stack.
+ */
+static uint8_t PushCachedProxy(duk_context* ctx, const char* key)
+{
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("proxyGen"));
+    if (duk_get_uint(ctx, -1) != proxyGeneration) {
+        duk_pop(ctx);
+        return FALSE;
+    }
+    duk_pop(ctx);
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("proxies"));
+    duk_get_prop_string(ctx, -1, key);
+    if (!duk_is_object(ctx, -1)) {
+        duk_pop_2(ctx);
+        return FALSE;
+    }
+    duk_remove(ctx, -2);
+    duk_remove(ctx, -2);
+    PushProxyInstance(ctx);
+    return TRUE;
+}
+
+/*
+ * Called with a method or signal object on the top of the stack. Caches the object on the service
+ * object so the message setup does not need to be repeated if the script asks for it again, and
+ * replaces it with a new instance of the cached object.
+ */
+static void CacheProxy(duk_context* ctx, const char* key)
+{
+    /*
+     * Instances share the marshalling plan compiled for the cached object
+     */
+    duk_push_string(ctx, AJS_HIDDEN_PROP("shared"));
+    duk_push_true(ctx);
+    duk_def_prop(ctx, -3, DUK_DEFPROP_HAVE_VALUE);
+
+    duk_push_this(ctx);
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("proxyGen"));
+    if (duk_get_uint(ctx, -1) != proxyGeneration) {
+        duk_push_string(ctx, AJS_HIDDEN_PROP("proxies"));
+        duk_push_object(ctx);
+        duk_def_prop(ctx, -4, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_WRITABLE | DUK_DEFPROP_WRITABLE);
+        duk_push_string(ctx, AJS_HIDDEN_PROP("proxyGen"));
+        duk_push_uint(ctx, proxyGeneration);
+        duk_def_prop(ctx, -4, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_WRITABLE | DUK_DEFPROP_WRITABLE);
+    }
+    duk_pop(ctx);
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("proxies"));
+    duk_dup(ctx, -3);
+    duk_put_prop_string(ctx, -2, key);
+    duk_pop_2(ctx);
+    PushProxyInstance(ctx);
+}
+
 static int NativeMethod(duk_context* ctx)
 {
     const char* member;
     const char* iface;
+    const char* key = NULL;
 
     duk_push_this(ctx);
+    /*
+     * Method objects requested by name are cached on the service object
+     */
+    if (duk_is_string(ctx, 0)) {
+        key = duk_push_sprintf(ctx, "?%s", duk_get_string(ctx, 0));
+        duk_swap_top(ctx, -2);
+        if (PushCachedProxy(ctx, key)) {
+            return 1;
+        }
+    }
     iface = FindInterfaceForMember(ctx, 0, &member);
 
     if (!iface || !member) {
@@ -317,6 +879,11 @@ static int NativeMethod(duk_context* ctx)
      */
     duk_push_c_lightfunc(ctx, AJS_MarshalMethodCall, DUK_VARARGS, 0, 0);
     duk_put_prop_string(ctx, -2, "call");
+    duk_push_c_lightfunc(ctx, AJS_MarshalMethodCallStream, DUK_VARARGS, 0, 0);
+    duk_put_prop_string(ctx, -2, "callStream");
+    if (key) {
+        CacheProxy(ctx, key);
+    }
     /* return the method object we just created */
     return 1;
 }
@@ -361,21 +928,37 @@ static void InitSignal(duk_context* ctx, const char* dest, uint32_t session)
     duk_put_prop_string(ctx, -2, "path");
     duk_push_c_lightfunc(ctx, AJS_MarshalSignal, DUK_VARARGS, 0, 0);
     duk_put_prop_string(ctx, -2, "send");
+    duk_push_c_lightfunc(ctx, AJS_MarshalSignalStream, DUK_VARARGS, 0, 0);
+    duk_put_prop_string(ctx, -2, "sendStream");
 }
 
 static int NativeSignal(duk_context* ctx)
 {
     const char* dest;
+    const char* key = NULL;
     uint32_t session;
 
     duk_push_this(ctx);
+    /*
+     * Signal objects requested by name are cached on the service object
+     */
+    if (duk_is_string(ctx, 0) && duk_is_string(ctx, 1)) {
+        key = duk_push_sprintf(ctx, "!%s %s", duk_get_string(ctx, 0), duk_get_string(ctx, 1));
+        duk_swap_top(ctx, -2);
+        if (PushCachedProxy(ctx, key)) {
+            return 1;
+        }
+    }
     duk_get_prop_string(ctx, -1, "dest");
     dest = duk_get_string(ctx, -1);
     duk_pop(ctx);
     duk_get_prop_string(ctx, -1, "session");
     session = duk_get_int(ctx, -1);
-    duk_pop_2(ctx);
+    duk_pop(ctx);
     InitSignal(ctx, dest, session);
+    if (key) {
+        CacheProxy(ctx, key);
+    }
     return 1;
 }
 
@@ -400,7 +983,10 @@ static int NativeSetProp(duk_context* ctx)
     prop = duk_get_string(ctx, 0);
     duk_push_this(ctx);
     iface = FindInterfaceForMember(ctx, 0, &prop);
-    MessageSetup(ctx, &AJ_PropertiesIface[0][1], "Set", NULL, AJ_MSG_METHOD_CALL);
+    if (!PushCachedProxy(ctx, "#Set")) {
+        MessageSetup(ctx, &AJ_PropertiesIface[0][1], "Set", NULL, AJ_MSG_METHOD_CALL);
+        CacheProxy(ctx, "#Set");
+    }
     duk_push_string(ctx, iface);
     duk_push_string(ctx, prop);
     duk_dup(ctx, 1);
@@ -420,7 +1006,10 @@ static int NativeGetProp(duk_context* ctx)
     prop = duk_get_string(ctx, 0);
     duk_push_this(ctx);
     iface = FindInterfaceForMember(ctx, 0, &prop);
-    MessageSetup(ctx, &AJ_PropertiesIface[0][1], "Get", NULL, AJ_MSG_METHOD_CALL);
+    if (!PushCachedProxy(ctx, "#Get")) {
+        MessageSetup(ctx, &AJ_PropertiesIface[0][1], "Get", NULL, AJ_MSG_METHOD_CALL);
+        CacheProxy(ctx, "#Get");
+    }
     duk_push_string(ctx, iface);
     duk_push_string(ctx, prop);
     duk_call_method(ctx, 2);
@@ -434,7 +1023,10 @@ static int NativeGetAllProps(duk_context* ctx)
     }
     duk_push_c_lightfunc(ctx, AJS_MarshalMethodCall, 1, 0, 0);
     duk_push_this(ctx);
-    MessageSetup(ctx, &AJ_PropertiesIface[0][1], "GetAll", NULL, AJ_MSG_METHOD_CALL);
+    if (!PushCachedProxy(ctx, "#GetAll")) {
+        MessageSetup(ctx, &AJ_PropertiesIface[0][1], "GetAll", NULL, AJ_MSG_METHOD_CALL);
+        CacheProxy(ctx, "#GetAll");
+    }
     duk_dup(ctx, 0);
     duk_call_method(ctx, 1);
     return 1;
@@ -443,11 +1035,14 @@ static int NativeGetAllProps(duk_context* ctx)
 static int NativeEnableSecurity(duk_context* ctx)
 {
     const char* peer;
+    SessionInfo* sessionInfo;
     const char* objPath;
     AJ_Status status = AJ_OK;
-    PeerInfo* info = (PeerInfo*)AJ_Malloc(sizeof(PeerInfo));
+    PeerInfo* info;
 
     AJ_InfoPrintf(("NativeEnableSecurity()\n"));
+    AJS_CheckNotStreaming(ctx, "enableSecurity");
+    info = (PeerInfo*)AJ_Malloc(sizeof(PeerInfo));
     if (!info) {
         duk_error(ctx, DUK_ERR_TYPE_ERROR, "Could not allocate PeerInfo, AJ_ERR_RESOURCES");
     }
@@ -465,14 +1060,19 @@ static int NativeEnableSecurity(duk_context* ctx)
 
     duk_get_prop_string(ctx, -1, "dest");
     peer = duk_get_string(ctx, -1);
+    sessionInfo = peer ? FindSession(peer) : NULL;
+    if (!sessionInfo) {
+        AJ_Free(info);
+        duk_error(ctx, DUK_ERR_REFERENCE_ERROR, "Peer has disconnected");
+    }
     /*
      * Set the peers status to AJS_SVC_AUTHENTICATING (not authenticated)
      */
-    SetPeerStatus(ctx, peer, AJS_SVC_AUTHENTICATING);
+    sessionInfo->authStatus = AJS_SVC_AUTHENTICATING;
     /*
      * Set the callback function for this peer
      */
-    AJS_GetGlobalStashObject(ctx, peer);
+    PushPeerObject(ctx, sessionInfo);
     duk_dup(ctx, 0);
     duk_put_prop_string(ctx, -2, "callback");
     /*
@@ -539,6 +1139,16 @@ void AJS_RegisterMsgFunctions(AJ_BusAttachment* bus, duk_context* ctx, duk_idx_t
      */
     duk_put_prop_string(ctx, -2, "peerProto");
     duk_pop(ctx);
+    /*
+     * Start with an empty session table
+     */
+    ResetSessionTable(ctx);
+    numInterests = 0;
+    interestOverflow = 0;
+    /*
+     * Table for calls that are waiting for a reply
+     */
+    AJS_InitReplyTable(ctx);
 }
 
 /*
@@ -568,20 +1178,169 @@ static int HasServiceCallback(duk_context* ctx, const char* iface)
 }
 
 /*
- * Called with "sessions" at the top of the stack.
- *
+ * Returns the position of the hash in the interest set or where it should be inserted
+ */
+static uint8_t FindInterest(uint32_t hash)
+{
+    uint8_t lo = 0;
+    uint8_t hi = numInterests;
+
+    while (lo < hi) {
+        uint8_t mid = (lo + hi) / 2;
+        if (interestSet[mid] < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static uint8_t HasInterest(const char* iface)
+{
+    uint32_t hash = HashName(iface);
+    uint8_t pos = FindInterest(hash);
+    return (pos < numInterests) && (interestSet[pos] == hash);
+}
+
+static void AddInterest(const char* iface)
+{
+    uint32_t hash = HashName(iface);
+    uint8_t pos = FindInterest(hash);
+
+    if ((pos < numInterests) && (interestSet[pos] == hash)) {
+        ++interestRefs[pos];
+    } else if (numInterests == AJS_MAX_SERVICE_INTERESTS) {
+        AJ_WarnPrintf(("AddInterest(): interest set is full\n"));
+        ++interestOverflow;
+    } else {
+        memmove(&interestSet[pos + 1], &interestSet[pos], (numInterests - pos) * sizeof(interestSet[0]));
+        memmove(&interestRefs[pos + 1], &interestRefs[pos], (numInterests - pos) * sizeof(interestRefs[0]));
+        interestSet[pos] = hash;
+        interestRefs[pos] = 1;
+        ++numInterests;
+    }
+}
+
+static void RemoveInterest(const char* iface)
+{
+    uint32_t hash = HashName(iface);
+    uint8_t pos = FindInterest(hash);
+
+    if ((pos < numInterests) && (interestSet[pos] == hash)) {
+        if (--interestRefs[pos] == 0) {
+            --numInterests;
+            memmove(&interestSet[pos], &interestSet[pos + 1], (numInterests - pos) * sizeof(interestSet[0]));
+            memmove(&interestRefs[pos], &interestRefs[pos + 1], (numInterests - pos) * sizeof(interestRefs[0]));
+        }
+    } else if (interestOverflow) {
+        --interestOverflow;
+    }
+}
+
+void AJS_SetServiceCallback(duk_context* ctx, const char* iface, duk_idx_t cbIdx)
+{
+    uint8_t hasCB;
+
+    cbIdx = duk_normalize_index(ctx, cbIdx);
+    AJS_GetGlobalStashObject(ctx, "serviceCB");
+    hasCB = duk_has_prop_string(ctx, -1, iface);
+    if (duk_is_callable(ctx, cbIdx)) {
+        uint8_t changed;
+        duk_get_prop_string(ctx, -1, iface);
+        changed = !duk_strict_equals(ctx, -1, cbIdx);
+        duk_pop(ctx);
+        duk_dup(ctx, cbIdx);
+        duk_put_prop_string(ctx, -2, iface);
+        if (!hasCB) {
+            AddInterest(iface);
+        }
+        /*
+         * An announcement that was dropped as unchanged may match the new callback so the next
+         * announcement from every peer must be processed again.
+         */
+        if (changed) {
+            size_t i;
+            for (i = 0; i < AJS_MAX_SESSIONS; ++i) {
+                sessionTable[i].annoHash = 0;
+            }
+        }
+    } else if (hasCB) {
+        duk_del_prop_string(ctx, -1, iface);
+        RemoveInterest(iface);
+    }
+    duk_pop(ctx);
+}
+
+/*
+ * Computes a hash over the object description in an announcement and checks the interfaces against
+ * the service interest set. This only uses the unmarshalled strings in the message buffer so
+ * nothing is allocated. The message arguments are reset so the announcement can be unmarshalled
+ * again.
+ */
+static uint32_t ScanAnnouncement(AJ_Message* msg, uint8_t* match)
+{
+    AJ_Status status;
+    uint16_t version;
+    uint16_t port;
+    AJ_Arg objList;
+    uint32_t hash;
+
+    *match = (interestOverflow != 0);
+    AJ_UnmarshalArgs(msg, "qq", &version, &port);
+    hash = (2166136261u ^ port) * 16777619u;
+    status = AJ_UnmarshalContainer(msg, &objList, AJ_ARG_ARRAY);
+    while (status == AJ_OK) {
+        AJ_Arg obj;
+        AJ_Arg interfaces;
+        const char* path;
+
+        status = AJ_UnmarshalContainer(msg, &obj, AJ_ARG_STRUCT);
+        if (status != AJ_OK) {
+            break;
+        }
+        AJ_UnmarshalArgs(msg, "o", &path);
+        hash = HashMore(hash, path);
+        status = AJ_UnmarshalContainer(msg, &interfaces, AJ_ARG_ARRAY);
+        while (status == AJ_OK) {
+            const char* iface;
+            status = AJ_UnmarshalArgs(msg, "s", &iface);
+            if (status == AJ_OK) {
+                hash = HashMore(hash, iface);
+                if (!*match && numInterests) {
+                    *match = HasInterest(iface);
+                }
+            }
+        }
+        if (status == AJ_ERR_NO_MORE) {
+            status = AJ_UnmarshalCloseContainer(msg, &interfaces);
+        }
+        if (status == AJ_OK) {
+            status = AJ_UnmarshalCloseContainer(msg, &obj);
+        }
+    }
+    AJ_ResetArgs(msg);
+    return hash;
+}
+
+/*
  * Iterate over the accumulated announcents and make callbacks into JavaScript
  */
-static void AnnouncementCallbacks(duk_context* ctx, const char* peer, SessionInfo* sessionInfo)
+static void AnnouncementCallbacks(duk_context* ctx, SessionInfo* sessionInfo)
 {
     size_t i;
     size_t numSvcs;
-    AJ_ASSERT(sessionInfo->sessionId);
+    const char* peer;
+    uint32_t sessionId = sessionInfo->sessionId;
+    AJ_ASSERT(sessionId);
     /*
-     * Get the session object (indexed by the peer string) and from this get the announcements array
+     * Get the peer object and from this get the peer name and the announcements array. The peer
+     * object stays on the stack so the name remains valid if a callback ends the session.
      */
-    duk_get_prop_string(ctx, -1, peer);
-    duk_get_prop_string(ctx, -1, "anno");
+    PushPeerObject(ctx, sessionInfo);
+    duk_get_prop_string(ctx, -1, "name");
+    peer = duk_get_string(ctx, -1);
+    duk_get_prop_string(ctx, -2, "anno");
     /*
      * Iterate over the services implemented by this peer
      */
@@ -626,14 +1385,14 @@ static void AnnouncementCallbacks(duk_context* ctx, const char* peer, SessionInf
                 /*
                  * Set the session information on the service
                  */
-                duk_push_int(ctx, sessionInfo->sessionId);
+                duk_push_int(ctx, sessionId);
                 duk_put_prop_string(ctx, svcIdx, "session");
                 duk_push_string(ctx, peer);
                 duk_put_prop_string(ctx, svcIdx, "dest");
                 /*
                  * Set the peer status for this new peer
                  */
-                SetPeerStatus(ctx, peer, AJS_SVC_NO_AUTH);
+                SetPeerStatus(peer, AJS_SVC_NO_AUTH);
                 /*
                  * Call the callback function
                  */
@@ -653,8 +1412,8 @@ static void AnnouncementCallbacks(duk_context* ctx, const char* peer, SessionInf
          */
         duk_del_prop_index(ctx, -1, i);
     }
-    /* Pop "anno" and the session object */
-    duk_pop_2(ctx);
+    /* Pop "anno", the peer name and the peer object */
+    duk_pop_3(ctx);
 }
 
 /*
@@ -688,26 +1447,22 @@ static void AddServiceObject(duk_context* ctx, SessionInfo* sessionInfo, const c
 
 AJ_Status AJS_FoundAdvertisedName(duk_context* ctx, AJ_Message* msg)
 {
-    AJ_Status status;
     SessionInfo* sessionInfo;
+    duk_idx_t anIdx;
     const char* name;
     const char* prefix;
     uint16_t port;
     uint16_t mask;
     duk_idx_t fnmeIdx;
-    duk_idx_t sessIdx;
 
     AJ_UnmarshalArgs(msg, "sqs", &name, &mask, &prefix);
 
     AJ_InfoPrintf(("AJS_FoundAdvertisedName %s %s\n", prefix, name));
 
-    AJS_GetGlobalStashObject(ctx, "sessions");
-    sessIdx = duk_get_top_index(ctx);
     /*
      * If the name is already listed we can ignore this signal
      */
-    if (duk_get_prop_string(ctx, -1, name)) {
-        duk_pop_2(ctx);
+    if (FindSession(name)) {
         return AJ_OK;
     }
     /*
@@ -716,111 +1471,78 @@ AJ_Status AJS_FoundAdvertisedName(duk_context* ctx, AJ_Message* msg)
     AJS_GetGlobalStashObject(ctx, "findName");
     duk_get_prop_string(ctx, -1, prefix);
     if (duk_is_undefined(ctx, -1)) {
-        duk_pop_3(ctx);
+        duk_pop_2(ctx);
         return AJ_OK;
     }
     fnmeIdx = duk_get_top_index(ctx);
+    sessionInfo = AllocSession(ctx, name);
+    if (!sessionInfo) {
+        duk_pop_2(ctx);
+        return AJ_ERR_RESOURCES;
+    }
     /*
      * From here on we make it look like we received an announcement
      */
     port = AJS_GetIntProp(ctx, fnmeIdx, "port");
-    status = AJ_BusJoinSession(msg->bus, name, port, NULL);
-    if (status == AJ_OK) {
-        duk_idx_t anIdx;
-        duk_idx_t svcIdx;
-        /*
-         * Create service object and add it to the sessions array
-         */
-        svcIdx = duk_push_object(ctx);
-        /*
-         * Set the "info" and "anno" properties on the service object
-         */
-        sessionInfo = duk_push_fixed_buffer(ctx, sizeof(SessionInfo));
-        sessionInfo->port = port;
-        duk_put_prop_string(ctx, svcIdx, "info");
-        anIdx = duk_push_array(ctx);
-        /*
-         * Push array of interfaces
-         */
-        duk_get_prop_string(ctx, fnmeIdx, "interfaces");
-        /*
-         * Set the callback to be called when the JOIN_SESSION reply is received
-         */
-        AJS_GetGlobalStashObject(ctx, "serviceCB");
-        duk_get_prop_index(ctx, -2, 0);           /* key - first interface in "interfaces" array */
-        duk_get_prop_string(ctx, fnmeIdx, "cb");  /* val - callback function */
-        duk_put_prop(ctx, -3);
-        duk_pop(ctx);
-        /* Interfaces array is at the top of the stack */
-        AddServiceObject(ctx, sessionInfo, AJS_GetStringProp(ctx, fnmeIdx, "path"), name);
-        /*
-         * Append service object to the announcements array for processing later
-         */
-        duk_put_prop_index(ctx, anIdx, duk_get_length(ctx, anIdx));
-
-        AJ_ASSERT(duk_get_top_index(ctx) == anIdx);
-        duk_put_prop_string(ctx, svcIdx, "anno");
-        AJ_ASSERT(duk_get_top_index(ctx) == svcIdx);
-        duk_put_prop_string(ctx, sessIdx, name);
-        /*
-         * Store the reply serial number for the JOIN_SESSION reply
-         */
-        sessionInfo->replySerial = msg->bus->serial - 1;
-    } else {
-        duk_del_prop_string(ctx, sessIdx, prefix);
-    }
+    sessionInfo->port = port;
+    /*
+     * Get the announcements array from the peer object
+     */
+    PushPeerObject(ctx, sessionInfo);
+    duk_get_prop_string(ctx, -1, "anno");
+    anIdx = duk_get_top_index(ctx);
+    /*
+     * Push array of interfaces
+     */
+    duk_get_prop_string(ctx, fnmeIdx, "interfaces");
+    /*
+     * Set the callback to be called when the JOIN_SESSION reply is received
+     */
+    duk_get_prop_index(ctx, -1, 0);           /* first interface in "interfaces" array */
+    duk_get_prop_string(ctx, fnmeIdx, "cb");  /* callback function */
+    AJS_SetServiceCallback(ctx, duk_get_string(ctx, -2), -1);
+    duk_pop_2(ctx);
+    /* Interfaces array is at the top of the stack */
+    AddServiceObject(ctx, sessionInfo, AJS_GetStringProp(ctx, fnmeIdx, "path"), name);
+    /*
+     * Append service object to the announcements array for processing later
+     */
+    duk_put_prop_index(ctx, anIdx, duk_get_length(ctx, anIdx));
+    AJ_ASSERT(duk_get_top_index(ctx) == anIdx);
+    /* Pop "anno" and the peer object */
+    duk_pop_2(ctx);
+    /*
+     * The join scheduler sends the JOIN_SESSION
+     */
+    QueueJoin(sessionInfo, 0);
     /* Clean up the stack */
-    duk_pop_n(ctx, 4);
-    return status;
-}
-
-/*
- * Create a session object if we don't have one for this peer. Leave the session object on the top
- * of the stack when this function returns.
- */
-static SessionInfo* AllocSessionObject(duk_context* ctx, const char* name)
-{
-    SessionInfo* sessionInfo;
-
-    if (duk_get_prop_string(ctx, -1, name)) {
-        duk_get_prop_string(ctx, -1, "info");
-        sessionInfo = duk_get_buffer(ctx, -1, NULL);
-        duk_pop(ctx);
-    } else {
-        /*
-         * Replace whatever we got with the object we need
-         */
-        duk_pop(ctx);
-        duk_push_object(ctx);
-        duk_dup(ctx, -1);
-        duk_put_prop_string(ctx, -3, name);
-        sessionInfo = duk_push_fixed_buffer(ctx, sizeof(SessionInfo));
-        duk_put_prop_string(ctx, -2, "info");
-        duk_push_array(ctx);
-        duk_put_prop_string(ctx, -2, "anno");
-    }
-    return sessionInfo;
+    duk_pop_2(ctx);
+    return AJ_OK;
 }
 
 /*
  * Announcements are processed as follows:
  *
- * 1) First check if there is an existing session for the announcement sender. If not create and
- *    initialize an empty session object. A session object has two properties "info" which is a buffer
- *    that holds state information about the session and an array "anno" which is used to accumulate
- *    announcements from the same sender.
+ * 1) First check if there is an existing session table entry for the announcement sender. If not
+ *    allocate one. The session table entry holds state information about the session and the peer
+ *    object for the entry has an array "anno" which is used to accumulate announcements from the
+ *    same sender.
  * 2) Unmarshal the announcement signal and if there is a callback registered for any of the
  *    interfaces add a service object to announcements array. The "interfaces" property on the
  *    service object is an array of all interfaces in the announcement.
- * 3) If there is already a session with the announcement sender make callbacks now, otherwise send
+ * 3) If there is already a session with the announcement sender make callbacks now, otherwise queue
  *    a JOIN_SESSION method call to join the session with the announcement sender. The callbacks are
  *    reevaluated when the JOIN_SESSION reply is received.
+ *
+ * Peers re-announce periodically so an announcement with the same object description as the last
+ * one from a peer that has a session, or a join in progress, is dropped before step 1.
  */
 AJ_Status AJS_AboutAnnouncement(duk_context* ctx, AJ_Message* msg)
 {
-    AJ_BusAttachment* aj = msg->bus;
     AJ_Status status;
     uint16_t version;
+    uint32_t annoHash;
+    uint8_t match;
     duk_idx_t anIdx;
     SessionInfo* sessionInfo;
     AJ_Arg objList;
@@ -835,15 +1557,41 @@ AJ_Status AJS_AboutAnnouncement(duk_context* ctx, AJ_Message* msg)
         AJ_InfoPrintf(("Ignoring our own announcement\n"));
         return AJ_OK;
     }
+    /*
+     * Nothing to do if there is no service callback for any of the announced interfaces unless
+     * there is already a session with the sender.
+     */
+    sessionInfo = FindSession(msg->sender);
+    if (!sessionInfo && !numInterests && !interestOverflow) {
+        AJ_InfoPrintf(("Ignoring announcement from %s\n", msg->sender));
+        return AJ_OK;
+    }
+    annoHash = ScanAnnouncement(msg, &match);
+    if (!sessionInfo && !match) {
+        AJ_InfoPrintf(("Ignoring announcement from %s\n", msg->sender));
+        return AJ_OK;
+    }
+    if (sessionInfo && (sessionInfo->annoHash == annoHash)) {
+        if (sessionInfo->sessionId || sessionInfo->joinOp || sessionInfo->joinQueued) {
+            AJ_InfoPrintf(("Dropping unchanged announcement from %s\n", msg->sender));
+            ++sessionStats.annoDropped;
+            return AJ_OK;
+        }
+    }
     /*
      * Push the sender string on the stack to stabilize it.
      */
     sender = duk_push_string(ctx, msg->sender);
     /*
-     * Announcements are accumulated in a global stash object indexed by peer name
+     * Announcements are accumulated on the peer object for the session table entry
      */
-    AJS_GetGlobalStashObject(ctx, "sessions");
-    sessionInfo = AllocSessionObject(ctx, sender);
+    sessionInfo = AllocSession(ctx, sender);
+    if (!sessionInfo) {
+        duk_pop(ctx);
+        return AJ_ERR_RESOURCES;
+    }
+    sessionInfo->annoHash = annoHash;
+    PushPeerObject(ctx, sessionInfo);
     /*
      * Get the announcements array
      */
@@ -909,179 +1657,192 @@ AJ_Status AJS_AboutAnnouncement(duk_context* ctx, AJ_Message* msg)
         status = AJ_UnmarshalCloseContainer(msg, &objList);
     }
     /*
-     * All done with this message - we need to close it now to free up the output buffer before we
-     * attempt to call AJ_BusJoinSession() below.
+     * All done with this message
      */
     AJ_CloseMsg(msg);
 
-    /* Pop "anno" and the session object */
+    /* Pop "anno" and the peer object */
     duk_pop_2(ctx);
 
-    if (status != AJ_OK) {
-        goto Exit;
-    }
     /*
      * If we already have a session with this peer callback with the new service objects
      */
     if (sessionInfo->sessionId) {
-        AnnouncementCallbacks(ctx, sender, sessionInfo);
+        if (status == AJ_OK) {
+            AnnouncementCallbacks(ctx, sessionInfo);
+        }
         goto Exit;
     }
     /*
-     * If there is a JOIN_SESSION in progress we have nothing more to do
+     * If there is a JOIN_SESSION queued or in progress we have nothing more to do
      */
-    if (sessionInfo->replySerial != 0) {
+    if (sessionInfo->joinOp || sessionInfo->joinQueued) {
         goto Exit;
     }
     /*
-     * If announcements were registered attempt to join the session
-     */
-    if (sessionInfo->refCount) {
-        status = AJ_BusJoinSession(aj, sender, sessionInfo->port, NULL);
-        if (status == AJ_OK) {
-            sessionInfo->replySerial = aj->serial - 1;
-        }
-    }
-    /*
-     * At this point if we don't have a JOIN_SESSION in progress we must delete the session object
+     * If announcements were registered queue a join with the peer, otherwise we must free the
+     * session table entry
      */
-    if (sessionInfo->replySerial == 0) {
-        duk_del_prop_string(ctx, -2, sender);
+    if ((status == AJ_OK) && sessionInfo->refCount) {
+        QueueJoin(sessionInfo, 0);
+    } else {
+        FreeSession(ctx, sessionInfo);
     }
 
 Exit:
 
-    /* Pop "sessions" and sender string */
-    duk_pop_2(ctx);
+    /* Pop sender string */
+    duk_pop(ctx);
     return status;
 }
 
-AJ_Status AJS_ServiceSessions(duk_context* ctx)
+AJ_Status AJS_ServiceSessions(duk_context* ctx, uint32_t* msgTO)
 {
     /*
-     * Loop through pending sessions and determine if the service callback should be called
+     * Only peers queued since the last call are processed, peers queued by the callbacks are
+     * processed on the next call.
      */
-    AuthStatus peerStatus;
-    const char* peer = NULL;
-    SessionInfo* sessionInfo = NULL;
-    uint8_t call = FALSE;
-
-    AJ_InfoPrintf(("AJS_ServiceSessions()\n"));
+    uint16_t count = authCount;
+    uint32_t wait;
 
-    AJS_GetGlobalStashObject(ctx, "sessions");
-
-    duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
-    while (duk_next(ctx, -1, 1)) {
-        peer = duk_get_string(ctx, -2);
-        AJ_ASSERT(duk_is_object(ctx, -1));
-        duk_pop_2(ctx);
-        peerStatus = GetPeerStatus(ctx, peer);
-        if (peerStatus == AJS_SVC_AUTHENTICATED) {
-            AJ_InfoPrintf(("AJS_ServiceSessions(): Peer %s status = %u\n", peer, peerStatus));
-            call = TRUE;
-            break;
+    while (numPendingLeaves) {
+        uint32_t sessionId = pendingLeaves[--numPendingLeaves];
+        if (AJS_IsRunning()) {
+            (void) AJ_BusLeaveSession(AJS_GetBusAttachment(), sessionId);
         }
     }
-    duk_pop(ctx); /* Pop the enum */
-    if (call) {
-        AJS_GetGlobalStashObject(ctx, peer);
-        duk_get_prop_string(ctx, -1, "callback");
-        duk_get_prop_string(ctx, -2, "service");
-        duk_push_int(ctx, TRUE);
+    /*
+     * Start any queued joins and make sure the message loop wakes up for the next one
+     */
+    wait = StartJoins(ctx);
+    if (wait < *msgTO) {
+        *msgTO = wait;
+    }
+    /*
+     * The queue is emptied if a callback ends all sessions
+     */
+    while (count-- && authCount) {
+        uint16_t entry = authQueue[authHead];
+        SessionInfo* sessionInfo = &sessionTable[entry];
+
+        authHead = (authHead + 1) % AJS_MAX_SESSIONS;
+        --authCount;
+        authQueued[entry] = FALSE;
+        /*
+         * The entry may have been freed or reused since it was queued
+         */
+        if (!sessionInfo->peer || (sessionInfo->authStatus != AJS_SVC_AUTHENTICATED)) {
+            continue;
+        }
+        AJ_InfoPrintf(("AJS_ServiceSessions(): Peer %s authenticated, calling service callback\n", sessionInfo->peer));
         /*
          * Set status to AJS_SVC_AUTH_DONE to not continually call the service callback
          */
-        SetPeerStatus(ctx, peer, AJS_SVC_AUTH_DONE);
-        AJ_InfoPrintf(("AJS_ServiceSessions(): Authenticated, calling service callback\n"));
-        AJS_DumpStack(ctx);
+        sessionInfo->authStatus = AJS_SVC_AUTH_DONE;
+        PushPeerObject(ctx, sessionInfo);
+        duk_get_prop_string(ctx, -1, "callback");
+        duk_get_prop_string(ctx, -2, "service");
+        duk_push_int(ctx, TRUE);
         if (duk_pcall(ctx, 2) != DUK_EXEC_SUCCESS) {
             AJS_ConsoleSignalError(ctx);
         }
         duk_pop_2(ctx);
-#ifndef NDEBUG
-    } else if (peerStatus == AJS_SVC_AUTHENTICATING) {
-        AJ_InfoPrintf(("AJS_ServiceSessions(): Authenticating peer %s\n", peer));
     }
-#else
-    }
-#endif
-    /* Pop "sessions" */
-    duk_pop(ctx);
-
     return AJ_OK;
 }
 
 AJ_Status AJS_HandleJoinSessionReply(duk_context* ctx, AJ_Message* msg)
 {
-    const char* peer = NULL;
     SessionInfo* sessionInfo = NULL;
-    uint32_t replySerial = msg->replySerial;
-    uint8_t joined = FALSE;
-
-    AJS_GetGlobalStashObject(ctx, "sessions");
-    duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
-    while (duk_next(ctx, -1, 1)) {
-        peer = duk_get_string(ctx, -2);
-        AJ_ASSERT(duk_is_object(ctx, -1));
-        duk_get_prop_string(ctx, -1, "info");
-        sessionInfo = duk_get_buffer(ctx, -1, NULL);
-        AJ_ASSERT(sessionInfo);
-        duk_pop_3(ctx);
-        if (sessionInfo->replySerial == replySerial) {
-            uint32_t sessionId;
-            uint32_t replyStatus;
-            /*
-             * Check if the join was successful
-             */
-            AJ_UnmarshalArgs(msg, "uu", &replyStatus, &sessionId);
-            if (replyStatus == AJ_JOINSESSION_REPLY_SUCCESS) {
-                /*
-                 * TODO - if we have a well-known name send a ping to get the unique name
-                 */
-                sessionInfo->sessionId = sessionId;
-                joined = TRUE;
-            }
-            sessionInfo->replySerial = 0;
+    uint32_t sessionId;
+    uint32_t replyStatus;
+    uint32_t now;
+    uint32_t elapsed;
+    uint16_t i;
+
+    for (i = 0; i < joinsInFlight; ++i) {
+        if (joinOps[i].serial == msg->replySerial) {
+            sessionInfo = &sessionTable[joinOps[i].entry];
             break;
         }
     }
-    duk_pop(ctx); /* Pop the enum */
-    if (joined) {
+    if (!sessionInfo) {
+        /*
+         * A late reply for a join that has already timed out, leave the session if it succeeded
+         */
+        if ((AJ_UnmarshalArgs(msg, "uu", &replyStatus, &sessionId) == AJ_OK) && (replyStatus == AJ_JOINSESSION_REPLY_SUCCESS)) {
+            AJ_InfoPrintf(("AJS_HandleJoinSessionReply(): Leaving session %u from a timed out join\n", sessionId));
+            return AJ_BusLeaveSession(AJS_GetBusAttachment(), sessionId);
+        }
+        return AJ_OK;
+    }
+    now = AJ_GetElapsedTime(&joinClock, TRUE);
+    elapsed = now - joinOps[i].start;
+    ++joinReplies;
+    joinTimeTotal += elapsed;
+    if (elapsed > sessionStats.joinTimeMax) {
+        sessionStats.joinTimeMax = elapsed;
+    }
+    EndJoin(sessionInfo);
+    /*
+     * Check if the join was successful
+     */
+    if (AJ_UnmarshalArgs(msg, "uu", &replyStatus, &sessionId) != AJ_OK) {
+        replyStatus = AJ_JOINSESSION_REPLY_FAILED;
+    }
+    AJ_CloseMsg(msg);
+    if (replyStatus != AJ_JOINSESSION_REPLY_SUCCESS) {
+        JoinFailed(ctx, sessionInfo);
+    } else {
+        sessionInfo->joinFailures = 0;
+        /*
+         * TODO - if we have a well-known name send a ping to get the unique name
+         */
+        SetSessionId(sessionInfo, sessionId);
+    }
+    /*
+     * Reuse the join slot before making any callbacks so the next join is already in progress
+     */
+    (void)StartJoins(ctx);
+    /*
+     * Record when the last outstanding join completed
+     */
+    if (!joinsQueued && !joinsInFlight) {
+        sessionStats.allJoinedTime = now;
+    }
+    if (replyStatus == AJ_JOINSESSION_REPLY_SUCCESS) {
         /*
          * TODO - we may need to initiate authentication with the remote peer
          */
-        AnnouncementCallbacks(ctx, peer, sessionInfo);
+        AnnouncementCallbacks(ctx, sessionInfo);
     }
-    /* Pop "sessions" */
-    duk_pop(ctx);
     return AJ_OK;
 }
 
 /*
- * Delete session info object pointed to by sessionId. If sessionId
- * is zero then delete all session info objects.
+ * Free the session table entry for sessionId. If sessionId is zero then leave all sessions and
+ * free all session table entries.
  */
 static AJ_Status RemoveSessions(duk_context* ctx, uint32_t sessionId)
 {
     AJ_Status status = AJ_OK;
-    AJS_GetGlobalStashObject(ctx, "sessions");
-    duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
-    while (duk_next(ctx, -1, 1)) {
-        SessionInfo* sessionInfo;
-        const char* peer = duk_get_string(ctx, -2);
-        duk_get_prop_string(ctx, -1, "info");
-        sessionInfo = duk_get_buffer(ctx, -1, NULL);
-        duk_pop_3(ctx);
-        if (sessionId == 0) {
-            AJ_InfoPrintf(("RemoveSessions(): Leaving session: %u\n", sessionInfo->sessionId));
-            status = AJ_BusLeaveSession(AJS_GetBusAttachment(), sessionInfo->sessionId);
-        } else if (sessionInfo->sessionId == sessionId) {
-            status = AJ_BusLeaveSession(AJS_GetBusAttachment(), sessionInfo->sessionId);
-            duk_del_prop_string(ctx, -2, peer);
-            break;
+
+    if (sessionId == 0) {
+        size_t i;
+        for (i = 0; i < AJS_MAX_SESSIONS; ++i) {
+            if (sessionTable[i].peer && sessionTable[i].sessionId) {
+                AJ_InfoPrintf(("RemoveSessions(): Leaving session: %u\n", sessionTable[i].sessionId));
+                status = AJ_BusLeaveSession(AJS_GetBusAttachment(), sessionTable[i].sessionId);
+            }
+        }
+        ResetSessionTable(ctx);
+    } else {
+        SessionInfo* sessionInfo = FindSessionById(sessionId);
+        if (sessionInfo) {
+            status = AJ_BusLeaveSession(AJS_GetBusAttachment(), sessionId);
+            FreeSession(ctx, sessionInfo);
         }
     }
-    duk_pop_2(ctx);
     /*
      * TODO - this is not all that useful because it only indicates that a peer has gone away
      * without being able to specify exactly which services are affected. The problem is we cannot
@@ -1089,6 +1850,10 @@ static AJ_Status RemoveSessions(duk_context* ctx, uint32_t sessionId)
      * to clean up sessions that are no longer in use. If we hold a reference the finalizer will
      * never get called.
      */
+    /*
+     * Method and signal objects cached on service objects may refer to a session that has gone
+     */
+    ++proxyGeneration;
     if (sessionId != 0) {
         AJS_GetAllJoynProperty(ctx, "onPeerDisconnected");
         if (duk_is_callable(ctx, -1)) {
@@ -1097,8 +1862,6 @@ static AJ_Status RemoveSessions(duk_context* ctx, uint32_t sessionId)
             }
         }
         duk_pop(ctx);
-    } else {
-        AJS_ClearGlobalStashObject(ctx, "sessions");
     }
     return status;
 }
@@ -1135,10 +1898,12 @@ AJ_Status AJS_HandleAcceptSession(duk_context* ctx, AJ_Message* msg, uint16_t po
     SessionInfo* sessionInfo;
 
     /*
-     * Create an entry in the sessions table so we can track this peer
+     * Create an entry in the session table so we can track this peer
      */
-    AJS_GetGlobalStashObject(ctx, "sessions");
-    sessionInfo = AllocSessionObject(ctx, joiner);
+    sessionInfo = AllocSession(ctx, joiner);
+    if (!sessionInfo) {
+        return AJ_BusReplyAcceptSession(msg, FALSE);
+    }
     /*
      * If there is no handler automatically accept the connection
      */
@@ -1161,19 +1926,17 @@ AJ_Status AJS_HandleAcceptSession(duk_context* ctx, AJ_Message* msg, uint16_t po
             accept = duk_get_boolean(ctx, -1);
         }
     }
-    duk_pop_2(ctx);
+    duk_pop(ctx);
     /*
      * It is possible that we already have an outbound session to this peer so if we are not
-     * accepting the session we can only delete the entry if the refCount is zero.
+     * accepting the session we can only free the entry if the refCount is zero.
      */
     if (accept) {
         ++sessionInfo->refCount;
         sessionInfo->port = port;
-        sessionInfo->sessionId = sessionId;
+        SetSessionId(sessionInfo, sessionId);
     } else if (sessionInfo->refCount == 0) {
-        duk_del_prop_string(ctx, -1, joiner);
+        FreeSession(ctx, sessionInfo);
     }
-    /* Pop sessions object */
-    duk_pop(ctx);
     return AJ_BusReplyAcceptSession(msg, accept);
-}
\ No newline at end of file
+}
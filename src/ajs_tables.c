@@ -50,6 +50,27 @@ static AJ_InterfaceDescription* interfaceTable;
 static AJ_Object* objectList;
 static AJ_Object proxyList[2];
 
+/*
+ * Maps a message id to the slot in the "memberFuncs" stash array that holds the handler registered
+ * by AJ.on() for that interface member. The table is sorted by message id.
+ */
+typedef struct {
+    uint32_t msgId;
+    uint16_t slot;
+} MemberHandler;
+
+static MemberHandler* memberHandlers;
+static uint16_t numMemberHandlers;
+static uint8_t memberHandlersValid;
+
+/*
+ * Descriptors for the readable properties of each interface. The descriptors for an interface are
+ * terminated by an entry with a NULL name, propDescIndex holds the first descriptor for each
+ * interface in the interface table.
+ */
+static AJS_PropDesc* propDescs;
+static uint16_t* propDescIndex;
+
 static void AddArgs(duk_context* ctx, duk_idx_t strIdx, char inout)
 {
     int i;
@@ -238,6 +259,136 @@ static AJ_Status BuildInterfaceTable(duk_context* ctx, duk_idx_t ajIdx)
     return status;
 }
 
+/*
+ * Build an index from member names to the interface that defines them. The index is the stash
+ * object "memberIndex" where the value is the interface name or true if the member name is defined
+ * on more than one interface.
+ */
+static AJ_Status BuildMemberIndex(duk_context* ctx, duk_idx_t ajIdx)
+{
+    duk_idx_t indexIdx;
+
+    duk_push_global_stash(ctx);
+    indexIdx = duk_push_object(ctx);
+    duk_dup_top(ctx);
+    duk_put_prop_string(ctx, -3, "memberIndex");
+    duk_get_prop_string(ctx, ajIdx, "interfaceDefinition");
+    if (duk_is_object(ctx, -1)) {
+        duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
+        while (duk_next(ctx, -1, 1)) {
+            if (duk_is_object(ctx, -1)) {
+                duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
+                while (duk_next(ctx, -1, 0)) {
+                    const char* member = duk_get_string(ctx, -1);
+                    if (duk_has_prop_string(ctx, indexIdx, member)) {
+                        AJ_InfoPrintf(("Member %s is defined on more than one interface\n", member));
+                        duk_push_true(ctx);
+                    } else {
+                        duk_dup(ctx, -4);
+                    }
+                    duk_put_prop_string(ctx, indexIdx, member);
+                    duk_pop(ctx);
+                }
+                duk_pop(ctx);
+            }
+            duk_pop_2(ctx);
+        }
+        duk_pop(ctx);
+    }
+    duk_pop_3(ctx);
+    return AJ_OK;
+}
+
+const char* AJS_GetMemberInterface(duk_context* ctx, const char* member)
+{
+    const char* iface = NULL;
+
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "memberIndex");
+    if (duk_is_object(ctx, -1)) {
+        duk_get_prop_string(ctx, -1, member);
+        /*
+         * The interface name is held by the index so it remains valid after the pop
+         */
+        iface = duk_get_string(ctx, -1);
+        duk_pop(ctx);
+    }
+    duk_pop_2(ctx);
+    return iface;
+}
+
+/*
+ * Build descriptors for the readable properties from the property member strings in the interface
+ * table so that GetAll can be marshalled without looking up the interface definitions.
+ */
+static AJ_Status BuildPropertyDescriptors(duk_context* ctx)
+{
+    size_t numIfaces = 0;
+    size_t numDescs = 0;
+    size_t n = 0;
+    size_t i;
+    size_t m;
+
+    if (!interfaceTable) {
+        return AJ_OK;
+    }
+    for (i = 0; interfaceTable[i]; ++i) {
+        for (m = 1; interfaceTable[i][m]; ++m) {
+            if (interfaceTable[i][m][0] == '@') {
+                ++numDescs;
+            }
+        }
+        ++numIfaces;
+    }
+    propDescIndex = duk_alloc(ctx, numIfaces * sizeof(uint16_t));
+    propDescs = duk_alloc(ctx, (numDescs + numIfaces) * sizeof(AJS_PropDesc));
+    if (!propDescIndex || !propDescs) {
+        return AJ_ERR_RESOURCES;
+    }
+    /*
+     * Property names must be stable so we add them to the global stash array of member strings
+     */
+    AJS_GetGlobalStashArray(ctx, "members");
+    for (i = 0; i < numIfaces; ++i) {
+        propDescIndex[i] = (uint16_t)n;
+        for (m = 1; interfaceTable[i][m]; ++m) {
+            const char* mbr = interfaceTable[i][m];
+            if (mbr[0] == '@') {
+                size_t len = strcspn(mbr + 1, "<>=");
+                /*
+                 * Write-only properties are not returned by GetAll
+                 */
+                if (mbr[len + 1] != AJS_PROP_ACCESS_W) {
+                    propDescs[n].name = duk_push_lstring(ctx, mbr + 1, len);
+                    propDescs[n].sig = mbr + len + 2;
+                    duk_put_prop_index(ctx, -2, duk_get_length(ctx, -2));
+                    ++n;
+                }
+            }
+        }
+        propDescs[n].name = NULL;
+        propDescs[n].sig = NULL;
+        ++n;
+    }
+    duk_pop(ctx);
+    return AJ_OK;
+}
+
+const AJS_PropDesc* AJS_GetPropertyDescriptors(const char* iface)
+{
+    size_t i;
+
+    if (!propDescs) {
+        return NULL;
+    }
+    for (i = 0; interfaceTable[i]; ++i) {
+        if (strcmp(interfaceTable[i][0], iface) == 0) {
+            return &propDescs[propDescIndex[i]];
+        }
+    }
+    return NULL;
+}
+
 static AJ_InterfaceDescription LookupInterface(duk_context* ctx, const char* iface)
 {
     size_t i = 0;
@@ -406,6 +557,18 @@ void AJS_ResetTables(duk_context* ctx)
     memset(proxyList, 0, sizeof(proxyList));
     duk_free(ctx, (void*)interfaceTable);
     interfaceTable = NULL;
+    duk_free(ctx, memberHandlers);
+    memberHandlers = NULL;
+    numMemberHandlers = 0;
+    memberHandlersValid = FALSE;
+    duk_free(ctx, propDescs);
+    propDescs = NULL;
+    duk_free(ctx, propDescIndex);
+    propDescIndex = NULL;
+    AJS_InvalidatePropertyCache(ctx, NULL, NULL);
+    duk_push_global_stash(ctx);
+    duk_del_prop_string(ctx, -1, "memberIndex");
+    duk_pop(ctx);
 }
 
 void ExtractMember(duk_context* ctx, const char* member)
@@ -481,6 +644,12 @@ AJ_Status AJS_InitTables(duk_context* ctx, duk_idx_t ajIdx)
 {
     AJ_Status status = BuildInterfaceTable(ctx, ajIdx);
 
+    if (status == AJ_OK) {
+        status = BuildPropertyDescriptors(ctx);
+    }
+    if (status == AJ_OK) {
+        status = BuildMemberIndex(ctx, ajIdx);
+    }
     if (status == AJ_OK) {
         status = BuildLocalObjects(ctx, ajIdx);
     }
@@ -503,6 +672,168 @@ AJ_Status AJS_InitTables(duk_context* ctx, duk_idx_t ajIdx)
     return status;
 }
 
+/*
+ * Find a method or signal in an interface description, returns 0 if the member was not found
+ */
+static uint8_t FindMemberIndex(AJ_InterfaceDescription ifc, const char* member)
+{
+    size_t len = strlen(member);
+    uint8_t m;
+
+    for (m = 1; ifc[m]; ++m) {
+        const char* mbr = ifc[m];
+        if ((mbr[0] == '!' || mbr[0] == '?') && (strncmp(mbr + 1, member, len) == 0) && (mbr[len + 1] == ' ' || mbr[len + 1] == '\0')) {
+            return m;
+        }
+    }
+    return 0;
+}
+
+static AJ_Status AddMemberHandler(duk_context* ctx, uint32_t msgId, uint16_t slot)
+{
+    MemberHandler* table;
+    uint16_t i;
+
+    table = duk_realloc(ctx, memberHandlers, (numMemberHandlers + 1) * sizeof(MemberHandler));
+    if (!table) {
+        return AJ_ERR_RESOURCES;
+    }
+    memberHandlers = table;
+    /*
+     * Insertion sort, this table is only rebuilt when handlers are registered
+     */
+    for (i = numMemberHandlers; (i > 0) && (table[i - 1].msgId > msgId); --i) {
+        table[i] = table[i - 1];
+    }
+    table[i].msgId = msgId;
+    table[i].slot = slot;
+    ++numMemberHandlers;
+    return AJ_OK;
+}
+
+/*
+ * Add table entries for all of the message ids a member can be received on. These are the proxy
+ * object which is used for signals and any local objects that implement the interface.
+ */
+static AJ_Status AddMemberHandlers(duk_context* ctx, const char* iface, const char* member, uint16_t slot)
+{
+    AJ_Status status;
+    AJ_InterfaceDescription ifc;
+    uint8_t i;
+    uint8_t m;
+    uint8_t o;
+
+    for (i = 0; interfaceTable[i]; ++i) {
+        if (strcmp(interfaceTable[i][0], iface) == 0) {
+            break;
+        }
+    }
+    ifc = interfaceTable[i];
+    if (!ifc) {
+        AJ_WarnPrintf(("AJ.on: interface %s is not defined\n", iface));
+        return AJ_OK;
+    }
+    m = FindMemberIndex(ifc, member);
+    if (!m) {
+        AJ_WarnPrintf(("AJ.on: %s has no method or signal %s\n", iface, member));
+        return AJ_OK;
+    }
+    /*
+     * Member indices in a message id start at zero
+     */
+    status = AddMemberHandler(ctx, AJ_ENCODE_MESSAGE_ID(AJ_PRX_ID_FLAG, 0, i, m - 1), slot);
+    for (o = 0; (status == AJ_OK) && objectList && objectList[o].path; ++o) {
+        uint8_t j;
+        for (j = 0; objectList[o].interfaces && objectList[o].interfaces[j]; ++j) {
+            if (objectList[o].interfaces[j] == ifc) {
+                status = AddMemberHandler(ctx, AJ_ENCODE_MESSAGE_ID(JS_OBJ_INDEX, o, j, m - 1), slot);
+                break;
+            }
+        }
+    }
+    return status;
+}
+
+/*
+ * Rebuild the message id table from the handlers registered by AJ.on(). The handlers are held in
+ * the "memberHandlers" stash object keyed by interface then by member. The functions are copied
+ * into the "memberFuncs" stash array so they can be retrieved by slot number.
+ */
+static AJ_Status BuildMemberHandlers(duk_context* ctx)
+{
+    AJ_Status status = AJ_OK;
+    uint16_t slot = 0;
+    duk_idx_t funcsIdx;
+
+    duk_free(ctx, memberHandlers);
+    memberHandlers = NULL;
+    numMemberHandlers = 0;
+
+    duk_push_global_stash(ctx);
+    funcsIdx = duk_push_array(ctx);
+    duk_dup_top(ctx);
+    duk_put_prop_string(ctx, -3, "memberFuncs");
+    duk_get_prop_string(ctx, -2, "memberHandlers");
+    if (duk_is_object(ctx, -1)) {
+        duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
+        while ((status == AJ_OK) && duk_next(ctx, -1, 1)) {
+            const char* iface = duk_get_string(ctx, -2);
+            duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
+            while ((status == AJ_OK) && duk_next(ctx, -1, 1)) {
+                if (duk_is_callable(ctx, -1)) {
+                    status = AddMemberHandlers(ctx, iface, duk_get_string(ctx, -2), slot);
+                    duk_put_prop_index(ctx, funcsIdx, slot++);
+                    duk_pop(ctx);
+                } else {
+                    duk_pop_2(ctx);
+                }
+            }
+            duk_pop_3(ctx); // enum, key and value
+        }
+        duk_pop(ctx); // enum
+    }
+    duk_pop_3(ctx);
+    memberHandlersValid = TRUE;
+    return status;
+}
+
+void AJS_MemberHandlersChanged(void)
+{
+    memberHandlersValid = FALSE;
+}
+
+uint8_t AJS_PushMemberHandler(duk_context* ctx, uint32_t msgId)
+{
+    uint16_t lo = 0;
+    uint16_t hi;
+
+    if (!interfaceTable) {
+        return FALSE;
+    }
+    if (!memberHandlersValid && (BuildMemberHandlers(ctx) != AJ_OK)) {
+        AJ_ErrPrintf(("Failed to build member handler table\n"));
+    }
+    /*
+     * Binary search for the message id
+     */
+    hi = numMemberHandlers;
+    while (lo < hi) {
+        uint16_t mid = (lo + hi) / 2;
+        if (memberHandlers[mid].msgId < msgId) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if ((lo == numMemberHandlers) || (memberHandlers[lo].msgId != msgId)) {
+        return FALSE;
+    }
+    AJS_GetGlobalStashArray(ctx, "memberFuncs");
+    duk_get_prop_index(ctx, -1, memberHandlers[lo].slot);
+    duk_remove(ctx, -2);
+    return TRUE;
+}
+
 void AJS_AuthRegisterObject(const char* path, uint8_t index)
 {
     if (index == AJ_PRX_ID_FLAG) {
@@ -32,20 +32,38 @@
 
 #include "ajs.h"
 
+/*
+ * What an interval timer does when the deadline for one or more intervals has been missed
+ */
+#define OVERRUN_SKIP   0 /* Skip the missed intervals */
+#define OVERRUN_ONCE   1 /* Skip the missed intervals and pass the number missed to the timer function */
+#define OVERRUN_BURST  2 /* Call the timer function once for each missed interval */
+
 typedef struct _AJS_TIMER {
     uint8_t isInterval; /* TRUE for an interval timer */
+    uint8_t overrun;    /* Overrun policy for an interval timer */
+    uint16_t queuePos;  /* Position in the timer queue, for an unused entry the next free entry */
     uint32_t id;        /* Id for the timer composed from index + salt value */
     uint32_t interval;  /* Scheduling interval in milliseconds - not used for oneshot timers */
-    uint32_t countDown; /* Count down time */
+    uint32_t deadline;  /* Absolute time when the timer is due */
 } AJS_TIMER;
 
 #define NUM_TIMERS 2   /* number of timers to allocate initially */
 #define ADD_TIMERS 2   /* numer of timers to add if we need to expand the table */
-#define MAX_TIMERS 256 /* maximum number of timers */
 
+/*
+ * Timer identifiers hold the timer index in the upper bits and a salt value in the lower bits
+ */
+#define TIMER_INDEX_BITS  12
+#define MAX_TIMERS        (1 << TIMER_INDEX_BITS) /* maximum number of timers */
+
+#define GET_TIMER_INDEX(id)   ((id) >> (32 - TIMER_INDEX_BITS))
+#define SALT_TIMER_ID(index)  (((uint32_t)(index) << (32 - TIMER_INDEX_BITS)) | (++timerSalt & (0xFFFFFFFF >> TIMER_INDEX_BITS)))
 
-#define GET_TIMER_INDEX(id)   ((id) >> 24)
-#define SALT_TIMER_ID(index)  ((index << 24) | (++timerSalt & 0xFFFFFF))
+/*
+ * Marks the end of the free list
+ */
+#define NO_TIMER  MAX_TIMERS
 
 /*
  * Salt for uniquefying timer identifiers
@@ -53,65 +71,198 @@ typedef struct _AJS_TIMER {
 static uint32_t timerSalt;
 
 /*
- * Current deadline - zero means we don't know the deadline
+ * The timer queue is a binary min-heap of timer indices ordered by deadline
+ */
+static uint16_t numQueued;
+
+/*
+ * Head of the list of unused timer entries
+ */
+static uint16_t freeTimer;
+
+/*
+ * Number of functions in the immediate queue
+ */
+static uint32_t numImmediate;
+
+/*
+ * All timer deadlines are relative to this clock
+ */
+static AJ_Time timerClock;
+
+/*
+ * Current time in milliseconds, time wraps so deadlines must be compared using IsDue()
+ */
+static uint32_t Now(void)
+{
+    return AJ_GetElapsedTime(&timerClock, TRUE);
+}
+
+static uint8_t IsDue(uint32_t deadline, uint32_t now)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+/*
+ * Get the timer table and timer queue. These pointers become invalid if the timer table is resized
+ * so must be reloaded after calling into script.
+ */
+static AJS_TIMER* GetTimerTable(duk_context* ctx, uint16_t** queue, size_t* numTimers)
+{
+    AJS_TIMER* timers;
+
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "timerState");
+    timers = duk_get_buffer(ctx, -1, numTimers);
+    *numTimers = *numTimers / sizeof(AJS_TIMER);
+    duk_get_prop_string(ctx, -2, "timerQueue");
+    *queue = duk_get_buffer(ctx, -1, NULL);
+    duk_pop_3(ctx);
+    return timers;
+}
+
+static uint8_t QueueLess(AJS_TIMER* timers, uint16_t a, uint16_t b)
+{
+    return (int32_t)(timers[a].deadline - timers[b].deadline) < 0;
+}
+
+static void QueueSet(AJS_TIMER* timers, uint16_t* queue, uint16_t pos, uint16_t timerEntry)
+{
+    queue[pos] = timerEntry;
+    timers[timerEntry].queuePos = pos;
+}
+
+static void SiftUp(AJS_TIMER* timers, uint16_t* queue, uint16_t pos)
+{
+    uint16_t timerEntry = queue[pos];
+
+    while (pos > 0) {
+        uint16_t parent = (pos - 1) / 2;
+        if (!QueueLess(timers, timerEntry, queue[parent])) {
+            break;
+        }
+        QueueSet(timers, queue, pos, queue[parent]);
+        pos = parent;
+    }
+    QueueSet(timers, queue, pos, timerEntry);
+}
+
+static void SiftDown(AJS_TIMER* timers, uint16_t* queue, uint16_t pos)
+{
+    uint16_t timerEntry = queue[pos];
+
+    while (TRUE) {
+        uint16_t child = pos * 2 + 1;
+        if (child >= numQueued) {
+            break;
+        }
+        if (((child + 1) < numQueued) && QueueLess(timers, queue[child + 1], queue[child])) {
+            ++child;
+        }
+        if (!QueueLess(timers, queue[child], timerEntry)) {
+            break;
+        }
+        QueueSet(timers, queue, pos, queue[child]);
+        pos = child;
+    }
+    QueueSet(timers, queue, pos, timerEntry);
+}
+
+static void QueueInsert(AJS_TIMER* timers, uint16_t* queue, uint16_t timerEntry)
+{
+    QueueSet(timers, queue, numQueued, timerEntry);
+    SiftUp(timers, queue, numQueued++);
+}
+
+/*
+ * Restore the queue order after the deadline for a timer has changed
+ */
+static void QueueUpdate(AJS_TIMER* timers, uint16_t* queue, uint16_t timerEntry)
+{
+    uint16_t pos = timers[timerEntry].queuePos;
+
+    SiftUp(timers, queue, pos);
+    if (timers[timerEntry].queuePos == pos) {
+        SiftDown(timers, queue, pos);
+    }
+}
+
+static void QueueRemove(AJS_TIMER* timers, uint16_t* queue, uint16_t timerEntry)
+{
+    uint16_t pos = timers[timerEntry].queuePos;
+
+    if (pos != --numQueued) {
+        QueueSet(timers, queue, pos, queue[numQueued]);
+        QueueUpdate(timers, queue, queue[pos]);
+    }
+}
+
+/*
+ * Release a timer entry and delete the timer function
  */
-static uint32_t deadline = 0;
+static void FreeTimer(duk_context* ctx, AJS_TIMER* timers, uint16_t timerEntry)
+{
+    timers[timerEntry].id = 0;
+    timers[timerEntry].queuePos = freeTimer;
+    freeTimer = timerEntry;
+
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "timerFuncs");
+    duk_del_prop_index(ctx, -1, timerEntry);
+    duk_pop_2(ctx);
+}
 
 /*
  * The same function is used to register interval and one-shot timers
  */
-static int RegisterTimer(duk_context* ctx, uint32_t ms, uint8_t isInterval)
+static int RegisterTimer(duk_context* ctx, uint32_t ms, uint8_t isInterval, uint8_t overrun)
 {
     AJS_TIMER* timers;
+    uint16_t* queue;
     size_t numTimers;
-    size_t timerEntry;
+    uint16_t timerEntry;
 
     if (!duk_is_callable(ctx, 0)) {
         duk_error(ctx, DUK_ERR_TYPE_ERROR, "First argument must be a function");
     }
+    timers = GetTimerTable(ctx, &queue, &numTimers);
     /*
-     * Get the global state management objects
+     * Expand the timer table if there are no free entries
      */
-    duk_push_global_stash(ctx);
-    duk_get_prop_string(ctx, -1, "timerFuncs");
-    duk_get_prop_string(ctx, -2, "timerState");
-
-    timers = duk_get_buffer(ctx, -1, &numTimers);
-    numTimers = numTimers / sizeof(AJS_TIMER);
-    /*
-     * Find first free slot in the timer table expanding the table if necessary
-     */
-    for (timerEntry = 0; timerEntry <= numTimers; ++timerEntry) {
-        if (timerEntry == numTimers) {
-            numTimers += ADD_TIMERS;
-            if (numTimers > MAX_TIMERS) {
-                duk_error(ctx, DUK_ERR_ALLOC_ERROR, "Too many timers");
-            }
-            timers = duk_resize_buffer(ctx, -1, numTimers * sizeof(AJS_TIMER));
-            if (!timers) {
-                duk_error(ctx, DUK_ERR_ALLOC_ERROR, "Could not allocate timer");
-            }
+    if (freeTimer == NO_TIMER) {
+        size_t newTimers = numTimers + ADD_TIMERS;
+        if (newTimers > MAX_TIMERS) {
+            duk_error(ctx, DUK_ERR_ALLOC_ERROR, "Too many timers");
         }
-        /*
-         * Zero indicates an unused timer entry
-         */
-        if (timers[timerEntry].id == 0) {
-            break;
+        duk_push_global_stash(ctx);
+        duk_get_prop_string(ctx, -1, "timerQueue");
+        queue = duk_resize_buffer(ctx, -1, newTimers * sizeof(uint16_t));
+        duk_get_prop_string(ctx, -2, "timerState");
+        timers = duk_resize_buffer(ctx, -1, newTimers * sizeof(AJS_TIMER));
+        duk_pop_3(ctx);
+        if (!timers || !queue) {
+            duk_error(ctx, DUK_ERR_ALLOC_ERROR, "Could not allocate timer");
+        }
+        while (newTimers > numTimers) {
+            --newTimers;
+            timers[newTimers].id = 0;
+            timers[newTimers].queuePos = freeTimer;
+            freeTimer = (uint16_t)newTimers;
         }
     }
-    /*
-     * Pop the buffer off the stack
-     */
-    duk_pop(ctx);
+    timerEntry = freeTimer;
+    freeTimer = timers[timerEntry].queuePos;
     /*
      * Push the callable function onto the stack and set in array
      */
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "timerFuncs");
     duk_dup(ctx, 0);
     duk_put_prop_index(ctx, -2, timerEntry);
     /*
-     * Pop the callable, the timerFuncs array and the global stash
+     * Pop the timerFuncs array and the global stash
      */
-    duk_pop_3(ctx);
+    duk_pop_2(ctx);
     /*
      * Push the salted timer index, this is what we will return from this call
      * Zero is reserved to indicate unused entries.
@@ -121,34 +272,29 @@ static int RegisterTimer(duk_context* ctx, uint32_t ms, uint8_t isInterval)
     } while (!timers[timerEntry].id);
     duk_push_int(ctx, timers[timerEntry].id);
     /*
-     * Set the interval and initialize the countDown timer
+     * Set the interval and deadline and queue the timer
      */
     timers[timerEntry].isInterval = isInterval;
+    timers[timerEntry].overrun = overrun;
     timers[timerEntry].interval = ms;
-    timers[timerEntry].countDown = ms;
-    /*
-     * We need to recompute the deadline
-     */
-    deadline = 0;
+    timers[timerEntry].deadline = Now() + ms;
+    QueueInsert(timers, queue, timerEntry);
 
     return 1;
 }
 
-static AJS_TIMER* GetTimer(duk_context* ctx, uint8_t isInterval)
+static AJS_TIMER* GetTimer(duk_context* ctx, uint8_t isInterval, uint16_t** queue)
 {
     AJS_TIMER* timers;
     size_t numTimers;
     uint32_t timerId = (uint32_t)duk_require_int(ctx, 0);
     uint32_t timerEntry = GET_TIMER_INDEX(timerId);
 
-    duk_push_global_stash(ctx);
-    duk_get_prop_string(ctx, -1, "timerState");
-    timers = duk_get_buffer(ctx, -1, &numTimers);
-    numTimers = numTimers / sizeof(AJS_TIMER);
+    timers = GetTimerTable(ctx, queue, &numTimers);
     /*
      * Check timer exists
      */
-    if ((timerEntry > numTimers) || (timerId != timers[timerEntry].id)) {
+    if ((timerEntry >= numTimers) || (timerId != timers[timerEntry].id)) {
         duk_error(ctx, DUK_ERR_RANGE_ERROR, "No such timer");
     }
     /*
@@ -157,42 +303,40 @@ static AJS_TIMER* GetTimer(duk_context* ctx, uint8_t isInterval)
     if (isInterval != timers[timerEntry].isInterval) {
         duk_error(ctx, DUK_ERR_TYPE_ERROR, "Timer has wrong type for this operation");
     }
-    duk_pop_3(ctx);
-    return &timers[timerEntry];
+    return timers;
 }
 
 static int ClearTimer(duk_context* ctx, uint8_t isInterval)
 {
-    AJS_TIMER* timer = GetTimer(ctx, isInterval);
-    uint32_t timerEntry = GET_TIMER_INDEX(timer->id);
+    uint16_t* queue;
+    AJS_TIMER* timers = GetTimer(ctx, isInterval, &queue);
+    uint16_t timerEntry = GET_TIMER_INDEX((uint32_t)duk_get_int(ctx, 0));
 
-    /*
-     * Clear timer
-     */
-    timer->id = 0;
-    /*
-     * Delete the timer entry
-     */
-    duk_push_global_stash(ctx);
-    duk_get_prop_string(ctx, -1, "timerFuncs");
-    duk_del_prop_index(ctx, -1, timerEntry);
-    duk_pop_2(ctx);
-    /*
-     * We need to recompute the deadline
-     */
-    deadline = 0;
+    QueueRemove(timers, queue, timerEntry);
+    FreeTimer(ctx, timers, timerEntry);
     return 0;
 }
 
 static int NativeSetInterval(duk_context* ctx)
 {
     uint32_t ms = duk_require_uint(ctx, 1);
+    uint8_t overrun = OVERRUN_SKIP;
 
     if (ms == 0) {
         duk_error(ctx, DUK_ERR_RANGE_ERROR, "Interval must be > 0");
     }
+    if (!duk_is_undefined(ctx, 2)) {
+        const char* policy = duk_require_string(ctx, 2);
+        if (strcmp(policy, "once") == 0) {
+            overrun = OVERRUN_ONCE;
+        } else if (strcmp(policy, "burst") == 0) {
+            overrun = OVERRUN_BURST;
+        } else if (strcmp(policy, "skip") != 0) {
+            duk_error(ctx, DUK_ERR_RANGE_ERROR, "Overrun policy must be 'skip', 'once', or 'burst'");
+        }
+    }
     AJ_InfoPrintf(("setInterval(%d)", ms));
-    return RegisterTimer(ctx, ms, TRUE);
+    return RegisterTimer(ctx, ms, TRUE, overrun);
 }
 
 static int NativeSetTimeout(duk_context* ctx)
@@ -200,26 +344,25 @@ static int NativeSetTimeout(duk_context* ctx)
     uint32_t ms = duk_require_uint(ctx, 1);
 
     AJ_InfoPrintf(("setTimeout(%d)", ms));
-    return RegisterTimer(ctx, ms, FALSE);
+    return RegisterTimer(ctx, ms, FALSE, OVERRUN_SKIP);
 }
 
 static int ResetTimer(duk_context* ctx, uint8_t isInterval)
 {
     uint32_t ms = duk_require_uint(ctx, 1);
-    AJS_TIMER* timer = GetTimer(ctx, isInterval);
+    uint16_t* queue;
+    AJS_TIMER* timers = GetTimer(ctx, isInterval, &queue);
+    AJS_TIMER* timer = &timers[GET_TIMER_INDEX((uint32_t)duk_get_int(ctx, 0))];
 
     if (isInterval && (ms == 0)) {
         duk_error(ctx, DUK_ERR_RANGE_ERROR, "Interval must be > 0");
     }
     /*
-     * Reset the timer properties
+     * Reset the timer properties and move the timer to its new position in the queue
      */
     timer->interval = ms;
-    timer->countDown = ms;
-    /*
-     * We need to recompute the deadline
-     */
-    deadline = 0;
+    timer->deadline = Now() + ms;
+    QueueUpdate(timers, queue, GET_TIMER_INDEX(timer->id));
     /*
      * Push the timer id, this is what we will return from this call
      */
@@ -247,29 +390,68 @@ static int NativeClearTimeout(duk_context* ctx)
     return ClearTimer(ctx, FALSE);
 }
 
+/*
+ * Immediate functions are appended to the "immediateFuncs" array and called in order from the
+ * message loop after the current handler returns.
+ */
+static int NativeSetImmediate(duk_context* ctx)
+{
+    if (!duk_is_callable(ctx, 0)) {
+        duk_error(ctx, DUK_ERR_TYPE_ERROR, "First argument must be a function");
+    }
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "immediateFuncs");
+    duk_dup(ctx, 0);
+    duk_put_prop_index(ctx, -2, numImmediate++);
+    duk_pop_2(ctx);
+    return 0;
+}
+
 static const duk_function_list_entry timer_native_functions[] = {
-    { "setInterval",   NativeSetInterval,   2 },
+    { "setInterval",   NativeSetInterval,   3 },
     { "clearInterval", NativeClearInterval, 1 },
     { "resetInterval", NativeResetInterval, 2 },
     { "setTimeout",    NativeSetTimeout,    2 },
     { "clearTimeout",  NativeClearTimeout,  1 },
     { "resetTimeout",  NativeResetTimeout,  2 },
+    { "setImmediate",  NativeSetImmediate,  1 },
+    { "queueMicrotask", NativeSetImmediate, 1 },
     { NULL }
 };
 
 AJ_Status AJS_RegisterTimerFuncs(duk_context* ctx)
 {
+    AJS_TIMER* timers;
+    size_t timerEntry;
+
     /*
-     * Timer state is managed via two global stash properties, "timerFuncs" is an array that holds
+     * Timer state is managed via three global stash properties, "timerFuncs" is an array that holds
      * references to the timer callback functions, "timerState" is a memory blob that holds an array
-     * of C structs that provide information about the active timers.
+     * of C structs that provide information about the active timers, and "timerQueue" is a memory
+     * blob that holds the active timers ordered by deadline. The "immediateFuncs" array holds the
+     * functions queued by setImmediate.
      */
     duk_push_global_stash(ctx);
     duk_push_array(ctx);
     duk_put_prop_string(ctx, -2, "timerFuncs");
-    duk_push_dynamic_buffer(ctx, NUM_TIMERS * sizeof(AJS_TIMER));
+    timers = duk_push_dynamic_buffer(ctx, NUM_TIMERS * sizeof(AJS_TIMER));
     duk_put_prop_string(ctx, -2, "timerState");
+    duk_push_dynamic_buffer(ctx, NUM_TIMERS * sizeof(uint16_t));
+    duk_put_prop_string(ctx, -2, "timerQueue");
+    duk_push_array(ctx);
+    duk_put_prop_string(ctx, -2, "immediateFuncs");
     duk_pop(ctx);
+    numImmediate = 0;
+    /*
+     * All entries start out on the free list
+     */
+    freeTimer = NO_TIMER;
+    for (timerEntry = NUM_TIMERS; timerEntry > 0; --timerEntry) {
+        timers[timerEntry - 1].queuePos = freeTimer;
+        freeTimer = (uint16_t)(timerEntry - 1);
+    }
+    numQueued = 0;
+    AJ_InitTimer(&timerClock);
     /*
      * Register interval and timeout functions
      */
@@ -277,96 +459,145 @@ AJ_Status AJS_RegisterTimerFuncs(duk_context* ctx)
     duk_put_function_list(ctx, -1, timer_native_functions);
     duk_pop(ctx);
 
-    deadline = 0;
-
     return AJ_OK;
 }
 
-AJ_Status AJS_RunTimers(duk_context* ctx, AJ_Time* clock, uint32_t* currentTO)
+AJ_Status AJS_RunTimers(duk_context* ctx, uint32_t* currentTO)
 {
     AJS_TIMER* timers;
+    uint16_t* queue;
     size_t numTimers;
-    size_t timerEntry;
-    uint32_t elapsed;
-
+    uint32_t now = Now();
     /*
-     * Time elapsed since this function was last called
+     * Limit the number of timeout callbacks so a timeout that keeps rescheduling itself with a zero
+     * timeout cannot starve the message loop. Interval timers always move past the current time.
      */
-    elapsed = AJ_GetElapsedTime(clock, FALSE);
-    AJ_InfoPrintf(("AJS_RunTimers deadline=%d elapsed=%d newTO=%d\n", deadline, elapsed, *currentTO));
-    /*
-     * Not much to do if there is a current timeout and we are working towards a deadline
-     */
-    if ((elapsed < *currentTO) && deadline) {
-        *currentTO -= elapsed;
-        return AJ_OK;
-    }
-    /*
-     * Get the global state management objects
-     */
-    duk_push_global_stash(ctx);
-    duk_get_prop_string(ctx, -1, "timerState");
-    timers = duk_get_buffer(ctx, -1, &numTimers);
-    numTimers = numTimers / sizeof(AJS_TIMER);
-    duk_get_prop_string(ctx, -2, "timerFuncs");
+    uint16_t budget = numQueued;
+
+    timers = GetTimerTable(ctx, &queue, &numTimers);
     /*
-     * Iterate over the timers and call functions at or past the deadline
+     * Call functions for the timers at or past the deadline, these are always at the head of the
+     * queue.
      */
-    for (timerEntry = 0; timerEntry < numTimers; ++timerEntry) {
+    while (numQueued && budget && IsDue(timers[queue[0]].deadline, now)) {
+        uint16_t timerEntry = queue[0];
         AJS_TIMER* timer = &timers[timerEntry];
-        if (timer->id != 0) {
-            AJ_InfoPrintf(("timer[%d].countDown = %d\n", (int)timerEntry, timer->countDown));
-            if (timer->countDown <= elapsed) {
-                /*
-                 * Get timer function on the stack
-                 */
-                duk_get_prop_index(ctx, -1, timerEntry);
-                /*
-                 * Update an interval timer or delete a one-shot timeout timer.
-                 */
-                if (timer->isInterval) {
-                    uint32_t delta = elapsed - deadline;
-                    if (delta > timer->interval) {
-                        AJ_ErrPrintf(("Unable to meet interval schedule\n"));
-                        delta = 0;
-                    }
-                    timer->countDown = timer->interval - delta;
-                } else {
-                    timer->id = 0;
-                    duk_del_prop_index(ctx, -2, timerEntry);
-                }
-                /*
-                 * Call the timer function
-                 */
-                if (duk_pcall(ctx, 0) != DUK_EXEC_SUCCESS) {
-                    AJS_ConsoleSignalError(ctx);
+        duk_idx_t numArgs = 0;
+
+        AJ_InfoPrintf(("timer[%d] due deadline=%u now=%u\n", timerEntry, timer->deadline, now));
+        /*
+         * Get timer function on the stack
+         */
+        duk_push_global_stash(ctx);
+        duk_get_prop_string(ctx, -1, "timerFuncs");
+        duk_get_prop_index(ctx, -1, timerEntry);
+        duk_remove(ctx, -2);
+        duk_remove(ctx, -2);
+        /*
+         * Reschedule an interval timer or delete a one-shot timeout timer. Interval deadlines are
+         * advanced from the previous deadline rather than from the current time so intervals do
+         * not drift. A burst timer stays at the head of the queue until it has caught up.
+         */
+        if (timer->isInterval) {
+            timer->deadline += timer->interval;
+            if (IsDue(timer->deadline, now) && (timer->overrun != OVERRUN_BURST)) {
+                uint32_t missed = (now - timer->deadline) / timer->interval + 1;
+                AJ_InfoPrintf(("timer[%d] missed %u intervals\n", timerEntry, missed));
+                timer->deadline += missed * timer->interval;
+                if (timer->overrun == OVERRUN_ONCE) {
+                    duk_push_uint(ctx, missed);
+                    numArgs = 1;
                 }
-                duk_pop(ctx); // return value
-            } else {
-                timer->countDown -= elapsed;
+            } else if (timer->overrun == OVERRUN_ONCE) {
+                duk_push_uint(ctx, 0);
+                numArgs = 1;
             }
+            SiftDown(timers, queue, 0);
+        } else {
+            QueueRemove(timers, queue, timerEntry);
+            FreeTimer(ctx, timers, timerEntry);
+            --budget;
+        }
+        /*
+         * Call the timer function
+         */
+        if (duk_pcall(ctx, numArgs) != DUK_EXEC_SUCCESS) {
+            AJS_ConsoleSignalError(ctx);
         }
+        duk_pop(ctx); // return value
+        /*
+         * The timer function may have added timers so reload the timer state
+         */
+        timers = GetTimerTable(ctx, &queue, &numTimers);
     }
     /*
-     * Pop timer funcs array
+     * The deadline for the next call is the deadline of the timer at the head of the queue
      */
+    if (numQueued == 0) {
+        *currentTO = 0xFFFFFFFF;
+    } else if (IsDue(timers[queue[0]].deadline, now)) {
+        *currentTO = 0;
+    } else {
+        *currentTO = timers[queue[0]].deadline - now;
+    }
+    AJ_InfoPrintf(("AJS_RunTimers deadline=%u\n", *currentTO));
+
+    return AJ_OK;
+}
+
+int32_t AJS_SetTimeout(duk_context* ctx, uint32_t ms)
+{
+    int32_t id;
+
+    duk_push_c_lightfunc(ctx, NativeSetTimeout, 2, 0, 0);
+    duk_insert(ctx, -2);
+    duk_push_uint(ctx, ms);
+    duk_call(ctx, 2);
+    id = duk_get_int(ctx, -1);
     duk_pop(ctx);
+    return id;
+}
+
+void AJS_ClearTimeout(duk_context* ctx, int32_t id)
+{
+    duk_push_c_lightfunc(ctx, NativeClearTimeout, 1, 0, 0);
+    duk_push_int(ctx, id);
     /*
-     * Reload the timer state and calculate the new deadline.
+     * Throws if the timer has already run
      */
-    timers = duk_get_buffer(ctx, -1, &numTimers);
-    numTimers = numTimers / sizeof(AJS_TIMER);
-    deadline = 0xFFFFFFFF;
-    for (timerEntry = 0; timerEntry < numTimers; ++timerEntry) {
-        if (timers[timerEntry].id != 0) {
-            deadline = min(timers[timerEntry].countDown, deadline);
-        }
-    }
+    (void)duk_pcall(ctx, 1);
+    duk_pop(ctx);
+}
 
-    duk_pop_2(ctx);
-    *currentTO = deadline;
+uint8_t AJS_ImmediatePending(void)
+{
+    return numImmediate != 0;
+}
 
-    AJ_InfoPrintf(("AJS_RunTimers deadline=%d\n", deadline));
+AJ_Status AJS_RunImmediate(duk_context* ctx)
+{
+    uint32_t count = numImmediate;
+    uint32_t i;
 
+    if (!count) {
+        return AJ_OK;
+    }
+    /*
+     * Swap in a new array so functions queued by the functions we are about to call are deferred
+     * until the next time this function is called.
+     */
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "immediateFuncs");
+    duk_push_array(ctx);
+    duk_put_prop_string(ctx, -3, "immediateFuncs");
+    numImmediate = 0;
+    for (i = 0; i < count; ++i) {
+        duk_get_prop_index(ctx, -1, i);
+        if (duk_pcall(ctx, 0) != DUK_EXEC_SUCCESS) {
+            AJS_ConsoleSignalError(ctx);
+        }
+        duk_pop(ctx); // return value
+    }
+    duk_pop_2(ctx);
     return AJ_OK;
-}
\ No newline at end of file
+}
@@ -35,9 +35,224 @@
 #include <ajtcl/aj_msg_priv.h>
 
 
-duk_idx_t AJS_UnmarshalMessage(duk_context* ctx, AJ_Message* msg, uint8_t accessor)
+/*
+ * Header fields for a lazily constructed message object. The strings are copied into the same fixed
+ * buffer as the header and are only pushed as JavaScript strings when a script reads them.
+ */
+typedef struct {
+    AJS_ReplyInternal reply; /* Must be first, the reply functions expect an AJS_ReplyInternal */
+    uint8_t msgType;
+    uint32_t replySerial;
+    uint16_t sender;         /* Offsets into str, zero if the field is not present */
+    uint16_t member;
+    uint16_t iface;
+    uint16_t path;
+    uint16_t error;
+    char str[1];
+} LazyMessage;
+
+static uint8_t lazyMessages = FALSE;
+
+void AJS_SetLazyMessages(uint8_t enable)
+{
+    lazyMessages = enable;
+}
+
+static LazyMessage* GetLazyMessage(duk_context* ctx)
+{
+    LazyMessage* lazy;
+
+    duk_push_this(ctx);
+    duk_get_prop_string(ctx, -1, AJS_HIDDEN_PROP("reply"));
+    lazy = duk_require_buffer(ctx, -1, NULL);
+    duk_pop_2(ctx);
+    return lazy;
+}
+
+static int PushLazyString(duk_context* ctx, const LazyMessage* lazy, uint16_t offset)
+{
+    if (!offset) {
+        return 0;
+    }
+    duk_push_string(ctx, lazy->str + offset);
+    return 1;
+}
+
+static int NativeGetSender(duk_context* ctx)
+{
+    LazyMessage* lazy = GetLazyMessage(ctx);
+
+    return PushLazyString(ctx, lazy, lazy->sender);
+}
+
+static int NativeGetMember(duk_context* ctx)
+{
+    LazyMessage* lazy = GetLazyMessage(ctx);
+
+    return PushLazyString(ctx, lazy, lazy->member);
+}
+
+static int NativeGetIface(duk_context* ctx)
+{
+    LazyMessage* lazy = GetLazyMessage(ctx);
+
+    return PushLazyString(ctx, lazy, lazy->iface);
+}
+
+static int NativeGetPath(duk_context* ctx)
+{
+    LazyMessage* lazy = GetLazyMessage(ctx);
+
+    return PushLazyString(ctx, lazy, lazy->path);
+}
+
+static int NativeGetError(duk_context* ctx)
+{
+    LazyMessage* lazy = GetLazyMessage(ctx);
+
+    return PushLazyString(ctx, lazy, lazy->error);
+}
+
+static int NativeGetFromSelf(duk_context* ctx)
+{
+    LazyMessage* lazy = GetLazyMessage(ctx);
+
+    if (((lazy->msgType != AJ_MSG_METHOD_CALL) && (lazy->msgType != AJ_MSG_SIGNAL)) || !lazy->sender) {
+        return 0;
+    }
+    duk_push_boolean(ctx, strcmp(lazy->str + lazy->sender, AJS_GetBusAttachment()->uniqueName) == 0);
+    return 1;
+}
+
+static int NativeGetReplySerial(duk_context* ctx)
+{
+    LazyMessage* lazy = GetLazyMessage(ctx);
+
+    if ((lazy->msgType != AJ_MSG_METHOD_RET) && (lazy->msgType != AJ_MSG_ERROR)) {
+        return 0;
+    }
+    duk_push_int(ctx, lazy->replySerial);
+    return 1;
+}
+
+static int NativeGetIsErrorReply(duk_context* ctx)
+{
+    LazyMessage* lazy = GetLazyMessage(ctx);
+
+    if ((lazy->msgType != AJ_MSG_METHOD_RET) && (lazy->msgType != AJ_MSG_ERROR)) {
+        return 0;
+    }
+    duk_push_boolean(ctx, lazy->msgType == AJ_MSG_ERROR);
+    return 1;
+}
+
+/*
+ * Push the shared prototype for lazy message objects. Method calls use a prototype that inherits
+ * from the message prototype and adds the reply functions.
+ */
+static void PushLazyPrototype(duk_context* ctx, uint8_t isMethodCall)
+{
+    AJS_GetGlobalStashObject(ctx, isMethodCall ? "callProto" : "msgProto");
+    if (duk_has_prop_string(ctx, -1, isMethodCall ? "reply" : "sender")) {
+        return;
+    }
+    if (isMethodCall) {
+        PushLazyPrototype(ctx, FALSE);
+        duk_set_prototype(ctx, -2);
+        duk_push_c_lightfunc(ctx, AJS_MethodCallReply, DUK_VARARGS, 0, 0);
+        duk_put_prop_string(ctx, -2, "reply");
+        duk_push_c_lightfunc(ctx, AJS_MethodCallError, DUK_VARARGS, 0, 0);
+        duk_put_prop_string(ctx, -2, "errorReply");
+        duk_push_c_lightfunc(ctx, AJS_MethodCallDefer, 1, 0, 0);
+        duk_put_prop_string(ctx, -2, "defer");
+    } else {
+        AJS_SetPropertyAccessors(ctx, -1, "sender", NULL, NativeGetSender);
+        AJS_SetPropertyAccessors(ctx, -1, "member", NULL, NativeGetMember);
+        AJS_SetPropertyAccessors(ctx, -1, "iface", NULL, NativeGetIface);
+        AJS_SetPropertyAccessors(ctx, -1, "path", NULL, NativeGetPath);
+        AJS_SetPropertyAccessors(ctx, -1, "fromSelf", NULL, NativeGetFromSelf);
+        AJS_SetPropertyAccessors(ctx, -1, "replySerial", NULL, NativeGetReplySerial);
+        AJS_SetPropertyAccessors(ctx, -1, "error", NULL, NativeGetError);
+        AJS_SetPropertyAccessors(ctx, -1, "isErrorReply", NULL, NativeGetIsErrorReply);
+    }
+}
+
+static size_t LazyStringLen(const char* str)
+{
+    return str ? strlen(str) + 1 : 0;
+}
+
+static uint16_t CopyLazyString(LazyMessage* lazy, uint16_t* pos, const char* str)
+{
+    uint16_t offset = *pos;
+    size_t len = LazyStringLen(str);
+
+    if (!str) {
+        return 0;
+    }
+    memcpy(lazy->str + offset, str, len);
+    *pos += (uint16_t)len;
+    return offset;
+}
+
+/*
+ * Pushes a message object that holds the header fields in a fixed buffer. Only one allocation is
+ * needed for the header fields, the JavaScript strings are created by the getters on the shared
+ * prototype if and when the script reads them.
+ */
+static duk_idx_t UnmarshalLazyMessage(duk_context* ctx, AJ_Message* msg, uint8_t accessor)
 {
     duk_idx_t objIndex = duk_push_object(ctx);
+    uint8_t hasMember = (msg->hdr->msgType == AJ_MSG_METHOD_CALL) || (msg->hdr->msgType == AJ_MSG_SIGNAL);
+    uint8_t hasError = (msg->hdr->msgType == AJ_MSG_ERROR);
+    size_t len = LazyStringLen(msg->sender);
+    LazyMessage* lazy;
+    uint16_t pos = 1;
+
+    PushLazyPrototype(ctx, msg->hdr->msgType == AJ_MSG_METHOD_CALL);
+    duk_set_prototype(ctx, objIndex);
+
+    if (hasMember) {
+        len += LazyStringLen(msg->member) + LazyStringLen(msg->iface) + LazyStringLen(msg->objPath);
+    }
+    if (hasError) {
+        len += LazyStringLen(msg->error);
+    }
+    duk_push_string(ctx, AJS_HIDDEN_PROP("reply"));
+    lazy = duk_push_fixed_buffer(ctx, sizeof(LazyMessage) + len);
+    memset(lazy, 0, sizeof(LazyMessage));
+    lazy->msgType = msg->hdr->msgType;
+    lazy->sender = CopyLazyString(lazy, &pos, msg->sender);
+    if (hasMember) {
+        lazy->member = CopyLazyString(lazy, &pos, msg->member);
+        lazy->iface = CopyLazyString(lazy, &pos, msg->iface);
+        lazy->path = CopyLazyString(lazy, &pos, msg->objPath);
+    }
+    if (hasError) {
+        lazy->error = CopyLazyString(lazy, &pos, msg->error);
+    }
+    if (msg->hdr->msgType == AJ_MSG_METHOD_CALL) {
+        lazy->reply.msgId = msg->msgId;
+        lazy->reply.flags = msg->hdr->flags;
+        lazy->reply.serialNum = msg->hdr->serialNum;
+        lazy->reply.sessionId = msg->sessionId;
+        lazy->reply.accessor = accessor;
+    } else {
+        AJ_InfoPrintf(("Reply serial %d\n", msg->replySerial));
+        lazy->replySerial = msg->replySerial;
+    }
+    duk_def_prop(ctx, objIndex, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_WRITABLE);
+    return objIndex;
+}
+
+duk_idx_t AJS_UnmarshalMessage(duk_context* ctx, AJ_Message* msg, uint8_t accessor)
+{
+    duk_idx_t objIndex;
+
+    if (lazyMessages) {
+        return UnmarshalLazyMessage(ctx, msg, accessor);
+    }
+    objIndex = duk_push_object(ctx);
 
     duk_push_string(ctx, msg->sender);
     duk_put_prop_string(ctx, objIndex, "sender");
@@ -73,6 +288,8 @@ duk_idx_t AJS_UnmarshalMessage(duk_context* ctx, AJ_Message* msg, uint8_t access
             duk_put_prop_string(ctx, objIndex, "reply");
             duk_push_c_lightfunc(ctx, AJS_MethodCallError, DUK_VARARGS, 0, 0);
             duk_put_prop_string(ctx, objIndex, "errorReply");
+            duk_push_c_lightfunc(ctx, AJS_MethodCallDefer, 1, 0, 0);
+            duk_put_prop_string(ctx, objIndex, "defer");
         }
     } else {
         int isError = (msg->hdr->msgType == AJ_MSG_ERROR);
@@ -91,18 +308,97 @@ duk_idx_t AJS_UnmarshalMessage(duk_context* ctx, AJ_Message* msg, uint8_t access
 }
 
 /*
- * Push a scalar array as a buffer.
+ * Push a scalar array. The whole array is unmarshalled in one call, AJ_UnmarshalArg has already
+ * converted the elements to native endianess. Byte arrays are pushed as a buffer, other scalar
+ * arrays are pushed as a JavaScript array filled directly from the array data.
  */
 static AJ_Status PushScalarArrayArg(duk_context* ctx, uint8_t typeId, AJ_Message* msg)
 {
     AJ_Arg arg;
     AJ_Status status = AJ_UnmarshalArg(msg, &arg);
-    void* buf = duk_push_fixed_buffer(ctx, arg.len);
+    duk_idx_t arrIdx;
+    size_t num;
+    size_t i;
 
-    if (buf) {
-        memcpy(buf, arg.val.v_data, arg.len);
-    } else {
-        status = AJ_ERR_RESOURCES;
+    if (status != AJ_OK) {
+        return status;
+    }
+    if (typeId == AJ_ARG_BYTE) {
+        void* buf = duk_push_fixed_buffer(ctx, arg.len);
+        if (buf) {
+            memcpy(buf, arg.val.v_data, arg.len);
+        } else {
+            status = AJ_ERR_RESOURCES;
+        }
+        return status;
+    }
+    arrIdx = duk_push_array(ctx);
+    switch (typeId) {
+    case AJ_ARG_BOOLEAN:
+        num = arg.len / sizeof(uint32_t);
+        for (i = 0; i < num; ++i) {
+            duk_push_boolean(ctx, arg.val.v_bool[i]);
+            duk_put_prop_index(ctx, arrIdx, (duk_uarridx_t)i);
+        }
+        break;
+
+    case AJ_ARG_UINT32:
+        num = arg.len / sizeof(uint32_t);
+        for (i = 0; i < num; ++i) {
+            duk_push_uint(ctx, arg.val.v_uint32[i]);
+            duk_put_prop_index(ctx, arrIdx, (duk_uarridx_t)i);
+        }
+        break;
+
+    case AJ_ARG_INT32:
+        num = arg.len / sizeof(int32_t);
+        for (i = 0; i < num; ++i) {
+            duk_push_int(ctx, arg.val.v_int32[i]);
+            duk_put_prop_index(ctx, arrIdx, (duk_uarridx_t)i);
+        }
+        break;
+
+    case AJ_ARG_UINT16:
+        num = arg.len / sizeof(uint16_t);
+        for (i = 0; i < num; ++i) {
+            duk_push_uint(ctx, arg.val.v_uint16[i]);
+            duk_put_prop_index(ctx, arrIdx, (duk_uarridx_t)i);
+        }
+        break;
+
+    case AJ_ARG_INT16:
+        num = arg.len / sizeof(int16_t);
+        for (i = 0; i < num; ++i) {
+            duk_push_int(ctx, arg.val.v_int16[i]);
+            duk_put_prop_index(ctx, arrIdx, (duk_uarridx_t)i);
+        }
+        break;
+
+    case AJ_ARG_DOUBLE:
+        num = arg.len / sizeof(double);
+        for (i = 0; i < num; ++i) {
+            duk_push_number(ctx, arg.val.v_double[i]);
+            duk_put_prop_index(ctx, arrIdx, (duk_uarridx_t)i);
+        }
+        break;
+
+    case AJ_ARG_UINT64:
+        /* TODO this will lose precision for numbers ~> 2^52*/
+        num = arg.len / sizeof(uint64_t);
+        for (i = 0; i < num; ++i) {
+            duk_push_number(ctx, (double)arg.val.v_uint64[i]);
+            duk_put_prop_index(ctx, arrIdx, (duk_uarridx_t)i);
+        }
+        break;
+
+    case AJ_ARG_INT64:
+        /* TODO this will lose precision for numbers ~> 2^52*/
+        num = arg.len / sizeof(int64_t);
+        for (i = 0; i < num; ++i) {
+            duk_push_number(ctx, (double)arg.val.v_int64[i]);
+            duk_put_prop_index(ctx, arrIdx, (duk_uarridx_t)i);
+        }
+        break;
     }
     return status;
 }
@@ -251,7 +547,7 @@ static AJ_Status PushArg(duk_context* ctx, AJ_Message* msg)
     } else if (typeId == AJ_ARG_ARRAY) {
         if (sig[1] == AJ_ARG_DICT_ENTRY) {
             status = PushDictionaryArg(ctx, msg);
-        } else if (sig[1] == AJ_ARG_BYTE) {
+        } else if (AJ_IsScalarType(sig[1])) {
             status = PushScalarArrayArg(ctx, sig[1], msg);
         } else {
             status = PushContainerArg(ctx, AJ_ARG_ARRAY, msg);
@@ -281,6 +577,12 @@ AJ_Status AJS_UnmarshalPropArgs(duk_context* ctx, AJ_Message* msg, uint8_t acces
             duk_push_string(ctx, AJS_HIDDEN_PROP("propIface"));
             duk_dup(ctx, -2);
             duk_def_prop(ctx, msgIdx, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_WRITABLE);
+            /*
+             * Save the object path so the reply can be cached for the object
+             */
+            duk_push_string(ctx, AJS_HIDDEN_PROP("propPath"));
+            duk_push_string(ctx, msg->objPath);
+            duk_def_prop(ctx, msgIdx, DUK_DEFPROP_HAVE_VALUE | DUK_DEFPROP_HAVE_WRITABLE);
         }
         /*
          * This call always returns an error status because the interface name we are passing in is
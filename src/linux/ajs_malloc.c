@@ -33,47 +33,134 @@
 #include "../ajs.h"
 #include "../ajs_heap.h"
 
+#ifdef AJS_HEAP_TRACE
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * The trace file starts with an 8 byte magic string, a 1 byte AJS_HEAP_POOL_ROUNDING and the 2 byte
+ * size of the pool descriptor, followed by the trace records. All values are little-endian,
+ * pointers are 8 bytes and sizes are 4 bytes.
+ *
+ *   'A' <ptr> <size>           allocation, ptr is zero if the allocation failed
+ *   'F' <ptr>                  free
+ *   'R' <ptr> <oldPtr> <size>  reallocation, ptr is zero if the reallocation failed
+ */
+static const char traceMagic[8] = { 'A', 'J', 'S', 'H', 'T', 'R', 'C', '2' };
+
+static FILE* traceFile;
+static uint32_t traceCount;
+
+static uint8_t* PutTraceVal(uint8_t* pos, uint64_t val, size_t len)
+{
+    while (len--) {
+        *pos++ = (uint8_t)val;
+        val >>= 8;
+    }
+    return pos;
+}
+
+void AJS_HeapTrace(uint8_t op, const void* mem, const void* oldMem, size_t sz)
+{
+    uint8_t rec[21];
+    uint8_t* pos = rec;
+
+    if (!traceFile) {
+        /*
+         * The trace file name can be set from the environment
+         */
+        const char* name = getenv("AJS_HEAP_TRACE");
+        traceFile = fopen(name ? name : "ajs_heap.trace", "wb");
+        if (!traceFile) {
+            return;
+        }
+        fwrite(traceMagic, sizeof(traceMagic), 1, traceFile);
+        *pos++ = AJS_HEAP_POOL_ROUNDING;
+        pos = PutTraceVal(pos, (uint64_t)AJS_HeapPoolOverhead(), 2);
+        fwrite(rec, pos - rec, 1, traceFile);
+        pos = rec;
+    }
+    *pos++ = op;
+    pos = PutTraceVal(pos, (uint64_t)(size_t)mem, 8);
+    if (op == AJS_HEAP_TRACE_REALLOC) {
+        pos = PutTraceVal(pos, (uint64_t)(size_t)oldMem, 8);
+    }
+    if (op != AJS_HEAP_TRACE_FREE) {
+        pos = PutTraceVal(pos, (uint64_t)sz, 4);
+    }
+    fwrite(rec, pos - rec, 1, traceFile);
+    /*
+     * Flush periodically so the trace is usable if the process is killed
+     */
+    if ((++traceCount & 0xFFF) == 0) {
+        fflush(traceFile);
+    }
+}
+#endif
+
 #ifndef AJS_USE_NATIVE_MALLOC
 
+/*
+ * The pools can be spread over 2 or 4 heaps to exercise multiple heap configurations on Linux. Build
+ * with define=AJS_NUM_HEAPS=<n> to enable this.
+ */
+#ifndef AJS_NUM_HEAPS
+#define AJS_NUM_HEAPS 1
+#endif
+
+#if (AJS_NUM_HEAPS != 1) && (AJS_NUM_HEAPS != 2) && (AJS_NUM_HEAPS != 4)
+#error "AJS_NUM_HEAPS must be 1, 2, or 4"
+#endif
+
+#define HEAP(n) (((n) * AJS_NUM_HEAPS) / 4)
+
 static const AJS_HeapConfig heapConfig[] = {
-    { 16,     200, 0, 0 },
-    { 24,     800, 0, 0 },
-    { 32,     800, 0, 0 },
-    { 48,     800, 0, 0 },
-    { 64,     800, 0, 0 },
-    { 96,     800, 0, 0 },
-    { 128,     64, 0, 0 },
-    { 256,     64, 0, 0 },
-    { 512,     16, 0, 0 },
-    { 1024,    16, 0, 0 },
-    { 2048,     8, 0, 0 },
-    { 3000,     8, 0, 0 },
-    { 4096,     2, 0, 0 },
-    { 16384,    2, 0, 0 }
+    { 16,     200, 0, HEAP(0) },
+    { 24,     800, 0, HEAP(0) },
+    { 32,     800, 0, HEAP(0) },
+    { 48,     800, 0, HEAP(0) },
+    { 64,     800, 0, HEAP(1) },
+    { 96,     800, 0, HEAP(2) },
+    { 128,     64, 0, HEAP(1) },
+    { 256,     64, 0, HEAP(1) },
+    { 512,     16, 0, HEAP(2) },
+    { 1024,    16, 0, HEAP(2) },
+    { 2048,     8, 0, HEAP(3) },
+    { 3000,     8, 0, HEAP(3) },
+    { 4096,     2, 0, HEAP(3) },
+    { 16384,    2, 0, HEAP(3) }
 };
 
-static uint32_t heap[500000 / 4];
+static uint32_t heap[AJS_NUM_HEAPS][500000 / 4 / AJS_NUM_HEAPS];
 
 AJ_Status AJS_HeapCreate()
 {
-    size_t heapSz[1];
-    uint8_t* heapPtr[1];
-    heapPtr[0] = &heap;
+    size_t heapSz[AJS_NUM_HEAPS];
+    void* heapPtr[AJS_NUM_HEAPS];
+    uint8_t i;
+
     /*
      * Allocate the heap pools
      */
-    heapSz[0] = AJS_HeapRequired(heapConfig, ArraySize(heapConfig), 0);
-    if (heapSz[0] > sizeof(heap)) {
-        AJ_ErrPrintf(("Heap space is too small %d required %d\n", (int)sizeof(heap), (int)heapSz[0]));
-        return AJ_ERR_RESOURCES;
+    for (i = 0; i < AJS_NUM_HEAPS; ++i) {
+        heapPtr[i] = heap[i];
+        heapSz[i] = AJS_HeapRequired(heapConfig, ArraySize(heapConfig), i);
+        if (heapSz[i] > sizeof(heap[i])) {
+            AJ_ErrPrintf(("Heap space is too small %d required %d\n", (int)sizeof(heap[i]), (int)heapSz[i]));
+            return AJ_ERR_RESOURCES;
+        }
+        AJ_Printf("Allocated heap %d %d bytes\n", i, (int)heapSz[i]);
     }
-    AJ_Printf("Allocated heap %d bytes\n", (int)heapSz);
-    AJS_HeapInit(heapPtr, heapSz, heapConfig, ArraySize(heapConfig), 1);
-    return AJ_OK;
+    return AJS_HeapInit(heapPtr, heapSz, heapConfig, ArraySize(heapConfig), AJS_NUM_HEAPS);
 }
 
 void AJS_HeapDestroy()
 {
+#ifdef AJS_HEAP_TRACE
+    if (traceFile) {
+        fflush(traceFile);
+    }
+#endif
 }
 
 #else
@@ -85,21 +172,33 @@ AJ_Status AJS_HeapCreate()
 
 void AJS_HeapDestroy()
 {
+#ifdef AJS_HEAP_TRACE
+    if (traceFile) {
+        fflush(traceFile);
+    }
+#endif
 }
 
 void* AJS_Alloc(void* userData, size_t sz)
 {
-    return malloc(sz);
+    void* mem = malloc(sz);
+    AJS_HeapTrace(AJS_HEAP_TRACE_ALLOC, mem, NULL, sz);
+    return mem;
 }
 
 void AJS_Free(void* userData, void* mem)
 {
+    if (mem) {
+        AJS_HeapTrace(AJS_HEAP_TRACE_FREE, mem, NULL, 0);
+    }
     return free(mem);
 }
 
 void* AJS_Realloc(void* userData, void* mem, size_t newSz)
 {
-    return realloc(mem, newSz);
+    void* newMem = realloc(mem, newSz);
+    AJS_HeapTrace(AJS_HEAP_TRACE_REALLOC, newMem, mem, newSz);
+    return newMem;
 }
 
 #ifndef NDEBUG
@@ -0,0 +1,408 @@
+#!/usr/bin/python
+
+#    Copyright (c) Open Connectivity Foundation (OCF), AllJoyn Open Source
+#    Project (AJOSP) Contributors and others.
+#
+#    SPDX-License-Identifier: Apache-2.0
+#
+#    All rights reserved. This program and the accompanying materials are
+#    made available under the terms of the Apache License, Version 2.0
+#    which accompanies this distribution, and is available at
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+#    Copyright (c) Open Connectivity Foundation and Contributors to AllSeen
+#    Alliance. All rights reserved.
+#
+#    Permission to use, copy, modify, and/or distribute this software for
+#    any purpose with or without fee is hereby granted, provided that the
+#    above copyright notice and this permission notice appear in all
+#    copies.
+#
+#    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+#    WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+#    WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+#    AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL
+#    DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR
+#    PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+#    TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+#    PERFORMANCE OF THIS SOFTWARE.
+#
+
+#
+# Replays a heap allocation trace recorded by a Linux build with HEAP_TRACE=on and computes an
+# AJS_HeapConfig[] pool table that minimizes the total heap size for a target allocation failure
+# probability. Each candidate configuration is replayed against the trace to report the heap size,
+# the memory lost to rounding allocations up to the pool size, idle pool entries, and the number of
+# allocations that would have failed.
+#
+# Usage: heaptune.py [options] <trace-file>
+#
+
+import sys, struct, bisect
+from optparse import OptionParser
+
+TRACE_MAGIC_V1 = b'AJSHTRC1'
+TRACE_MAGIC = b'AJSHTRC2'
+
+# AJS_HEAP_POOL_ROUNDING and sizeof(Pool) for the build that recorded the trace. These are read from
+# the trace header, version 1 traces do not record them so they must be given on the command line.
+POOL_ROUNDING = 4
+POOL_OVERHEAD = 48
+
+# Must match MIN_SEGMENT_SHIFT and MAX_SEGMENTS in src/ajs_heap.c
+MIN_SEGMENT_SHIFT = 4
+MAX_SEGMENTS = 1024
+
+# Limit on the number of candidate pool sizes and on the length of the compressed timeline
+MAX_CANDIDATES = 96
+MAX_WINDOWS = 2048
+
+def entry_size(size):
+    # Same rounding as EntrySize() in src/ajs_heap.c
+    return size + POOL_ROUNDING - (size & (POOL_ROUNDING - 1))
+
+def size_class(size):
+    return (size + POOL_ROUNDING - 1) // POOL_ROUNDING * POOL_ROUNDING
+
+def read_trace(fname):
+    """Returns a list of (op, ptr, oldPtr, size) tuples and the (rounding, overhead) from the header"""
+    f = open(fname, 'rb')
+    data = f.read()
+    f.close()
+    header = (None, None)
+    if data[:len(TRACE_MAGIC)] == TRACE_MAGIC:
+        header = struct.unpack_from('<BH', data, len(TRACE_MAGIC))
+        pos = len(TRACE_MAGIC) + 3
+    elif data[:len(TRACE_MAGIC_V1)] == TRACE_MAGIC_V1:
+        pos = len(TRACE_MAGIC_V1)
+    else:
+        raise ValueError('%s is not a heap trace file' % fname)
+    events = []
+    end = len(data)
+    while pos < end:
+        op = data[pos:pos + 1]
+        if op == b'A':
+            if pos + 13 > end:
+                break
+            ptr, size = struct.unpack_from('<QI', data, pos + 1)
+            events.append(('A', ptr, 0, size))
+            pos += 13
+        elif op == b'F':
+            if pos + 9 > end:
+                break
+            ptr, = struct.unpack_from('<Q', data, pos + 1)
+            events.append(('F', ptr, 0, 0))
+            pos += 9
+        elif op == b'R':
+            if pos + 21 > end:
+                break
+            ptr, oldPtr, size = struct.unpack_from('<QQI', data, pos + 1)
+            events.append(('R', ptr, oldPtr, size))
+            pos += 21
+        else:
+            raise ValueError('Corrupt trace record at offset %d' % pos)
+    return events, header
+
+def live_timeline(events):
+    """
+    Replays the trace with unlimited memory and returns the number of allocations in each size
+    class and a list of (event, sizeClass, delta) changes to the number of live blocks in each class.
+    """
+    live = {}
+    changes = []
+    sizes = {}
+    for n, (op, ptr, oldPtr, size) in enumerate(events):
+        if op == 'A':
+            if ptr:
+                sc = size_class(size)
+                live[ptr] = sc
+                changes.append((n, sc, 1))
+                sizes[sc] = sizes.get(sc, 0) + 1
+        elif op == 'F':
+            sc = live.pop(ptr, None)
+            if sc is not None:
+                changes.append((n, sc, -1))
+        elif ptr:
+            sc = live.pop(oldPtr, None) if oldPtr else None
+            if sc is not None:
+                changes.append((n, sc, -1))
+            sc = size_class(size)
+            live[ptr] = sc
+            changes.append((n, sc, 1))
+            sizes[sc] = sizes.get(sc, 0) + 1
+    return sizes, changes
+
+def candidate_sizes(sizes):
+    """Candidate pool sizes are the observed size classes thinned out to MAX_CANDIDATES"""
+    classes = sorted(sizes)
+    if len(classes) <= MAX_CANDIDATES:
+        return classes
+    # Keep the size classes that split the allocation count evenly and always keep the largest
+    total = sum(sizes.values())
+    step = float(total) / MAX_CANDIDATES
+    keep = []
+    acc = 0
+    next_cut = step
+    for sc in classes:
+        acc += sizes[sc]
+        if acc >= next_cut:
+            keep.append(sc)
+            while next_cut <= acc:
+                next_cut += step
+    if keep[-1] != classes[-1]:
+        keep.append(classes[-1])
+    return keep
+
+def window_demand(changes, candidates, num_events):
+    """
+    Returns for each candidate the peak number of live blocks that map to that candidate in each
+    window of the compressed timeline.
+    """
+    windows = min(MAX_WINDOWS, max(1, num_events))
+    width = float(max(1, num_events)) / windows
+    index = {}
+    demand = [[0] * windows for c in candidates]
+    count = [0] * len(candidates)
+    pos = 0
+    for w in range(windows):
+        end = (w + 1) * width
+        for c in range(len(candidates)):
+            demand[c][w] = count[c]
+        while pos < len(changes) and changes[pos][0] < end:
+            n, sc, delta = changes[pos]
+            if sc not in index:
+                index[sc] = bisect.bisect_left(candidates, sc)
+            c = index[sc]
+            count[c] += delta
+            if count[c] > demand[c][w]:
+                demand[c][w] = count[c]
+            pos += 1
+    return demand
+
+def entries_for(counts, fail_prob):
+    """Number of entries needed so the fraction of windows where demand exceeds it is <= fail_prob"""
+    ordered = sorted(counts)
+    if not ordered:
+        return 0
+    index = int((1.0 - fail_prob) * (len(ordered) - 1) + 0.999999)
+    return ordered[min(index, len(ordered) - 1)]
+
+def optimize(candidates, demand, max_pools, fail_prob):
+    """
+    Dynamic program over the sorted candidate sizes. A pool covering candidates a..b has entries of
+    size candidates[b] and must hold the combined demand of those candidates. Returns a dictionary
+    of the best configuration for each pool count.
+    """
+    m = len(candidates)
+    windows = len(demand[0]) if demand else 0
+    cost = {}
+    for a in range(m):
+        combined = [0] * windows
+        for b in range(a, m):
+            row = demand[b]
+            for w in range(windows):
+                combined[w] += row[w]
+            entries = entries_for(combined, fail_prob)
+            cost[(a, b)] = (entry_size(candidates[b]) * entries + POOL_OVERHEAD, entries)
+    inf = float('inf')
+    # best[k][b] is the minimum heap covering candidates 0..b with k pools
+    best = [[inf] * m for k in range(max_pools + 1)]
+    back = [[None] * m for k in range(max_pools + 1)]
+    for b in range(m):
+        best[1][b] = cost[(0, b)][0]
+    for k in range(2, max_pools + 1):
+        for b in range(m):
+            for a in range(k - 1, b + 1):
+                c = best[k - 1][a - 1] + cost[(a, b)][0]
+                if c < best[k][b]:
+                    best[k][b] = c
+                    back[k][b] = a
+    configs = {}
+    for k in range(1, max_pools + 1):
+        if best[k][m - 1] == inf:
+            continue
+        pools = []
+        b = m - 1
+        kk = k
+        while kk > 0:
+            a = back[kk][b] if kk > 1 else 0
+            pools.append((candidates[b], cost[(a, b)][1]))
+            b = a - 1
+            kk -= 1
+        pools.reverse()
+        configs[k] = [p for p in pools if p[1] > 0]
+    return configs
+
+def simulate(events, config):
+    """
+    Replays the trace against a pool configuration using the same rules as AJS_Alloc and
+    AJS_Realloc. Returns a dictionary of statistics for the configuration.
+    """
+    sizes = [p[0] for p in config]
+    entries = [p[1] for p in config]
+    borrow = [p[2] if len(p) > 2 else 0 for p in config]
+    use = [0] * len(config)
+    hwm = [0] * len(config)
+    live = {}
+    failed = 0
+    live_req = 0
+    live_blocks = 0
+    peak_blocks = 0
+    waste_at_peak = 0
+
+    def alloc(size):
+        i = bisect.bisect_left(sizes, size)
+        while i < len(sizes):
+            if use[i] < entries[i]:
+                use[i] += 1
+                hwm[i] = max(hwm[i], use[i])
+                return i
+            if not borrow[i]:
+                break
+            i += 1
+        return None
+
+    for op, ptr, oldPtr, size in events:
+        if op == 'A':
+            if not ptr:
+                continue
+            i = alloc(size)
+            if i is None:
+                failed += 1
+                continue
+            live[ptr] = (i, size)
+            live_req += size
+            live_blocks += entry_size(sizes[i])
+        elif op == 'F':
+            blk = live.pop(ptr, None)
+            if blk:
+                use[blk[0]] -= 1
+                live_req -= blk[1]
+                live_blocks -= entry_size(sizes[blk[0]])
+        elif ptr:
+            blk = live.pop(oldPtr, None) if oldPtr else None
+            if blk:
+                i, old = blk
+                if size <= sizes[i] and (i == 0 or size > sizes[i - 1]):
+                    live[ptr] = (i, size)
+                    live_req += size - old
+                    continue
+            n = alloc(size)
+            if n is None:
+                failed += 1
+                if blk:
+                    live[oldPtr] = blk
+                continue
+            if blk:
+                use[blk[0]] -= 1
+                live_req -= blk[1]
+                live_blocks -= entry_size(sizes[blk[0]])
+            live[ptr] = (n, size)
+            live_req += size
+            live_blocks += entry_size(sizes[n])
+        if live_blocks > peak_blocks:
+            peak_blocks = live_blocks
+            waste_at_peak = live_blocks - live_req
+
+    heap = sum(entry_size(s) * n for s, n in zip(sizes, entries)) + tables_required(config)
+    idle = sum(entry_size(s) * (n - h) for s, n, h in zip(sizes, entries, hwm))
+    return { 'heap': heap, 'peak': peak_blocks, 'rounding': waste_at_peak, 'idle': idle, 'failed': failed }
+
+def tables_required(config):
+    """Same as TablesRequired() in src/ajs_heap.c for a single heap"""
+    pools = [entry_size(size) * entries for size, entries in [c[:2] for c in config]]
+    heap = sum(pools)
+    min_pool = min([p for p in pools if p] or [0])
+    shift = MIN_SEGMENT_SHIFT
+    while (2 << shift) <= min_pool:
+        shift += 1
+    while (heap >> shift) >= MAX_SEGMENTS:
+        shift += 1
+    size = POOL_OVERHEAD * len(config)
+    size += (heap + (1 << shift) - 1) >> shift
+    size += size_class(max(c[0] for c in config)) // POOL_ROUNDING + 1
+    return (size + POOL_ROUNDING - 1) & ~(POOL_ROUNDING - 1)
+
+def parse_config(fname):
+    """Parses the heapConfig[] table from a target ajs_malloc.c file"""
+    import re
+    text = open(fname).read()
+    start = text.find('heapConfig[]')
+    if start < 0:
+        raise ValueError('No heapConfig[] table in %s' % fname)
+    body = text[text.find('{', start) + 1:text.find('};', start)]
+    config = []
+    for entry in re.findall(r'\{([^}]*)\}', body):
+        vals = [v.strip() for v in entry.split(',') if v.strip()]
+        borrow = 1 if len(vals) > 2 and vals[2] not in ('0', '') else 0
+        config.append((int(vals[0]), int(vals[1]), borrow))
+    return config
+
+def print_report(name, stats, failed_total):
+    rate = float(stats['failed']) / max(1, failed_total)
+    print('%-12s heap=%8d peak-use=%8d rounding-waste=%7d idle=%8d failed=%d (%.4f%%)' %
+          (name, stats['heap'], stats['peak'], stats['rounding'], stats['idle'], stats['failed'], rate * 100))
+
+def print_config(config):
+    print('static const AJS_HeapConfig heapConfig[] = {')
+    for i, (size, entries) in enumerate(config):
+        sep = ',' if i < len(config) - 1 else ''
+        print('    { %-6s %5d, 0, 0 }%s' % (str(size) + ',', entries, sep))
+    print('};')
+
+def main(argv = None):
+    parser = OptionParser(usage = 'usage: %prog [options] <trace-file>')
+    parser.add_option('-p', '--fail-prob', type = 'float', default = 0.0,
+                      help = 'Target fraction of time a pool may be exhausted (default 0)')
+    parser.add_option('-n', '--max-pools', type = 'int', default = 14,
+                      help = 'Maximum number of pools (default 14)')
+    parser.add_option('-c', '--config', metavar = 'FILE',
+                      help = 'Compare against the heapConfig[] table in a target ajs_malloc.c')
+    parser.add_option('-r', '--rounding', type = 'int',
+                      help = 'AJS_HEAP_POOL_ROUNDING of the target build (default from the trace)')
+    parser.add_option('-o', '--pool-overhead', type = 'int',
+                      help = 'sizeof(Pool) in bytes on the target build (default from the trace)')
+    (options, args) = parser.parse_args(argv)
+    if len(args) != 1:
+        parser.error('A trace file is required')
+
+    global POOL_ROUNDING, POOL_OVERHEAD
+    events, (rounding, overhead) = read_trace(args[0])
+    if options.rounding:
+        rounding = options.rounding
+    if options.pool_overhead is not None:
+        overhead = options.pool_overhead
+    if rounding is None or overhead is None:
+        parser.error('Trace has no header, --rounding and --pool-overhead are required')
+    if rounding not in (4, 8):
+        parser.error('Rounding must be 4 or 8')
+    POOL_ROUNDING = rounding
+    POOL_OVERHEAD = overhead
+    print('Pool rounding %d, pool overhead %d bytes' % (POOL_ROUNDING, POOL_OVERHEAD))
+    allocs = sum(1 for e in events if e[0] != 'F')
+    print('Read %d trace records, %d allocations' % (len(events), allocs))
+    if not allocs:
+        return 0
+
+    sizes, changes = live_timeline(events)
+    candidates = candidate_sizes(sizes)
+    demand = window_demand(changes, candidates, len(events))
+    configs = optimize(candidates, demand, max(1, options.max_pools), options.fail_prob)
+
+    print('')
+    print('Candidate configurations (fail-prob %g)' % options.fail_prob)
+    best = None
+    for k in sorted(configs):
+        stats = simulate(events, configs[k])
+        print_report('%d pools' % len(configs[k]), stats, allocs)
+        if best is None or stats['heap'] < best[1]['heap']:
+            best = (configs[k], stats)
+    if options.config:
+        print('')
+        print_report('current', simulate(events, parse_config(options.config)), allocs)
+    print('')
+    print_config(best[0])
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())